@@ -4,6 +4,8 @@
 #include "Ray.hpp"
 #include "Vec3.hpp"
 
+#include <algorithm>
+#include <cmath>
 #include <utility>
 
 class AABB
@@ -43,16 +45,23 @@ public:
 
     bool Hit(const Ray& ray, Interval ray_t) const
     {
-        const Point3& ray_origin = ray.Origin();
         const Vec3& ray_direction = ray.Direction();
+        const Vec3 inv_direction(1 / ray_direction.x(), 1 / ray_direction.y(), 1 / ray_direction.z());
 
+        return Hit(ray.Origin(), inv_direction, ray_t);
+    }
+
+    // Variant for traversals that test one ray against many boxes and can compute
+    // the reciprocal direction once.
+    bool Hit(const Point3& ray_origin, const Vec3& inv_direction, Interval ray_t) const
+    {
         for (int axis = 0; axis < 3; ++axis)
         {
             const Interval& ax = AxisInterval(axis);
-            const double adinv = 1.0 / ray_direction[axis];
+            const real adinv = inv_direction[axis];
 
-            const double t0 = (ax.min - ray_origin[axis]) * adinv;
-            const double t1 = (ax.max - ray_origin[axis]) * adinv;
+            const real t0 = (ax.min - ray_origin[axis]) * adinv;
+            const real t1 = (ax.max - ray_origin[axis]) * adinv;
 
             if (t0 < t1)
             {
@@ -74,6 +83,14 @@ public:
         return true;
     }
 
+    real SurfaceArea() const
+    {
+        const real dx = this->x.Size();
+        const real dy = this->y.Size();
+        const real dz = this->z.Size();
+        return 2 * (dx * dy + dy * dz + dz * dx);
+    }
+
     int LongestAxis() const
     {
         if (this->x.Size() > this->y.Size())
@@ -105,10 +122,26 @@ public:
 private:
     void PadToMinimus()
     {
-        const double delta = 0.0001;
-        if (x.Size() < delta) x = x.Expand(delta);
-        if (y.Size() < delta) y = y.Expand(delta);
-        if (z.Size() < delta) z = z.Expand(delta);
+        PadToMinimum(this->x);
+        PadToMinimum(this->y);
+        PadToMinimum(this->z);
+    }
+
+    // A box thinner than the rounding error of its coordinates lets rays slip
+    // through, so the minimum size grows with them once that error is larger
+    // than the fixed padding (in float builds, see `spawn_epsilon`).
+    static void PadToMinimum(Interval& axis)
+    {
+        if (axis.Size() < 0)
+        {
+            return;
+        }
+
+        const real delta = std::max(real(0.0001), spawn_epsilon * std::max(std::abs(axis.min), std::abs(axis.max)));
+        if (axis.Size() < delta)
+        {
+            axis = axis.Expand(delta);
+        }
     }
 };
 
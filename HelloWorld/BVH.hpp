@@ -0,0 +1,809 @@
+#pragma once
+
+// Pointer-free bounding volume hierarchy. It only knows about primitive bounding
+// boxes, so the same structure accelerates lists of hittables as well as the
+// triangles of a single mesh.
+
+#include "RTWeekend.hpp"
+
+#include "AABB.hpp"
+#include "Interval.hpp"
+#include "Ray.hpp"
+#include "RayPacket.hpp"
+#include "TaskPool.hpp"
+#include "Vec3.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Box of a node, in single precision whatever `real` is, which nearly halves the
+// size of a node in double builds. The bounds are rounded outward, so the box
+// still contains everything below the node and traversal misses nothing.
+struct BVHBounds
+{
+    static constexpr float float_infinity = std::numeric_limits<float>::infinity();
+
+    float min[3] = { float_infinity, float_infinity, float_infinity };
+    float max[3] = { -float_infinity, -float_infinity, -float_infinity };
+
+    BVHBounds() {}
+
+    explicit BVHBounds(const AABB& bbox)
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            const Interval& interval = bbox.AxisInterval(axis);
+            this->min[axis] = RoundDown(interval.min);
+            this->max[axis] = RoundUp(interval.max);
+        }
+    }
+
+    AABB ToAABB() const
+    {
+        AABB bbox;
+        bbox.x = Interval(this->min[0], this->max[0]);
+        bbox.y = Interval(this->min[1], this->max[1]);
+        bbox.z = Interval(this->min[2], this->max[2]);
+        return bbox;
+    }
+
+private:
+    static float RoundDown(const real value)
+    {
+        const float rounded = float(value);
+        return real(rounded) > value ? std::nextafter(rounded, -float_infinity) : rounded;
+    }
+
+    static float RoundUp(const real value)
+    {
+        const float rounded = float(value);
+        return real(rounded) < value ? std::nextafter(rounded, float_infinity) : rounded;
+    }
+};
+
+// Nodes are stored in depth-first order: the first child of an interior node is
+// always the node right after it, so only the second child needs an offset.
+struct BVHNode
+{
+    BVHBounds bounds;
+
+    uint32_t offset = 0;           // Leaf: first entry in `BVH::indices`. Interior: second child.
+    uint16_t primitive_count = 0;  // Zero for interior nodes.
+    uint16_t axis = 0;             // Split axis of interior nodes, used to order the traversal.
+
+    bool IsLeaf() const
+    {
+        return this->primitive_count > 0;
+    }
+};
+
+enum class BVHSplitMethod
+{
+    Median,  // Halve the primitives along the longest centroid axis.
+    SAH,     // Binned surface area heuristic.
+};
+
+struct BVHStats
+{
+    double sah_cost = 0;            // Expected cost of a random ray, relative to one primitive test
+    double build_milliseconds = 0;
+    size_t node_count = 0;
+    size_t leaf_count = 0;
+    int    depth = 0;
+};
+
+inline std::ostream& operator<<(std::ostream& out, const BVHStats& stats)
+{
+    return out
+        << "SAH cost " << stats.sah_cost
+        << ", build " << stats.build_milliseconds << " ms"
+        << ", " << stats.node_count << " nodes"
+        << ", " << stats.leaf_count << " leaves"
+        << ", depth " << stats.depth;
+}
+
+class BVH
+{
+public:
+    std::vector<BVHNode>  nodes;
+    std::vector<uint32_t> indices;  // Primitive indices, every leaf owns a contiguous range.
+
+    int thread_count = 0;  // Build threads, 0 means one per hardware thread
+
+    static constexpr int max_leaf_primitives = 2;   // Leaf size of the median split
+    static constexpr int max_sah_leaf_primitives = 8;
+    static constexpr int max_depth = 64;             // Size of the traversal stack.
+
+    // SAH cost model, relative to the cost of one primitive intersection.
+    static constexpr double traversal_cost = 1.0;
+    static constexpr double intersection_cost = 1.0;
+
+    static constexpr int sah_bin_count = 16;
+
+    // Ranges with at least this many primitives build their subtrees as separate
+    // tasks and split their bounds, binning and partitioning passes into chunks
+    // of about this size, one per thread at most.
+    static constexpr uint32_t parallel_build_cutoff = 4096;
+
+    void Build(const std::vector<AABB>& primitive_boxes, const BVHSplitMethod method = BVHSplitMethod::SAH)
+    {
+        const auto start = std::chrono::high_resolution_clock::now();
+
+        this->nodes.clear();
+        this->indices.resize(primitive_boxes.size());
+        this->stats = BVHStats();
+
+        if (primitive_boxes.empty())
+        {
+            return;
+        }
+
+        // All parallel work runs on one pool of threads, created only when there
+        // is enough of it.
+        const int thread_count = this->thread_count > 0 ? this->thread_count : std::max(1, (int)std::thread::hardware_concurrency());
+
+        std::unique_ptr<TaskPool> pool;
+        if (thread_count > 1 && primitive_boxes.size() >= parallel_build_cutoff)
+        {
+            pool = std::make_unique<TaskPool>(thread_count);
+        }
+        this->pool = pool.get();
+
+        this->centroids.resize(primitive_boxes.size());
+        this->scratch.resize(primitive_boxes.size());
+        ParallelFor(0, (uint32_t)primitive_boxes.size(), [&](const uint32_t begin, const uint32_t end)
+        {
+            for (uint32_t i = begin; i < end; ++i)
+            {
+                this->indices[i] = i;
+                this->centroids[i] = Centroid(primitive_boxes[i]);
+            }
+        });
+
+        // Forking a few levels past the thread count leaves enough tasks to keep
+        // every core busy even when the splits are uneven.
+        int fork_depth = 0;
+        while (this->pool != nullptr && (1 << fork_depth) < 4 * thread_count)
+        {
+            ++fork_depth;
+        }
+
+        // A binary tree with at least one primitive per leaf never has more than
+        // 2n - 1 nodes.
+        this->nodes.reserve(2 * primitive_boxes.size());
+
+        BuildRecursive(primitive_boxes, method, 0, (uint32_t)primitive_boxes.size(), 1, fork_depth, this->nodes);
+
+        this->pool = nullptr;
+        pool.reset();
+
+        this->nodes.shrink_to_fit();
+        this->centroids.clear();
+        this->centroids.shrink_to_fit();
+        this->scratch.clear();
+        this->scratch.shrink_to_fit();
+
+        const auto end = std::chrono::high_resolution_clock::now();
+        this->stats.build_milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+
+        ComputeStats();
+    }
+
+    // Takes over a hierarchy built earlier, e.g. one read back from a scene cache.
+    void Assign(std::vector<BVHNode> nodes, std::vector<uint32_t> indices)
+    {
+        this->nodes = std::move(nodes);
+        this->indices = std::move(indices);
+        this->stats = BVHStats();
+
+        if (this->nodes.empty() == false)
+        {
+            ComputeStats();
+        }
+    }
+
+    const BVHStats& Stats() const
+    {
+        return this->stats;
+    }
+
+    AABB BBox() const
+    {
+        return this->nodes.empty() ? AABB::Empty : this->nodes[0].bounds.ToAABB();
+    }
+
+    // Calls `intersect(primitive_index, ray_t)` for every primitive in a leaf the
+    // ray reaches. On a hit the callback must return true and shrink `ray_t.max`
+    // to the hit distance, so farther subtrees get culled.
+    template <typename IntersectPrimitive>
+    bool Traverse(const Ray& ray, const Interval ray_t, IntersectPrimitive&& intersect) const
+    {
+        return Walk<false>(ray, ray_t, intersect);
+    }
+
+    // Same as `Traverse()`, but returns as soon as `intersect` reports a hit. For
+    // visibility tests, where any hit will do and `ray_t` never has to shrink.
+    template <typename IntersectPrimitive>
+    bool TraverseAny(const Ray& ray, const Interval ray_t, IntersectPrimitive&& intersect) const
+    {
+        return Walk<true>(ray, ray_t, intersect);
+    }
+
+    // `Traverse()` for the lanes `active` of a packet. Calls
+    // `intersect(primitive_index, lanes)` with the lanes that reach the leaf,
+    // which has to return the lanes it hit and shrink their `packet.t_max`.
+    // Returns all lanes that hit something.
+    template <typename IntersectPrimitive>
+    uint32_t TraversePacket(RayPacket& packet, const uint32_t active, IntersectPrimitive&& intersect) const
+    {
+        if (this->nodes.empty() || active == 0)
+        {
+            return 0;
+        }
+
+        struct Entry
+        {
+            uint32_t node;
+            uint32_t lanes;
+        };
+
+        Entry stack[max_depth];
+        int stack_size = 0;
+        Entry current = { 0, active };
+
+        uint32_t hit_lanes = 0;
+
+        while (true)
+        {
+            const BVHNode& node = this->nodes[current.node];
+
+            // Lanes that miss the box leave the packet for the whole subtree.
+            const uint32_t lanes = packet.Hit(node.bounds.ToAABB(), current.lanes);
+            if (lanes != 0)
+            {
+                if (node.IsLeaf())
+                {
+                    for (uint32_t i = 0; i < node.primitive_count; ++i)
+                    {
+                        hit_lanes |= intersect(this->indices[node.offset + i], lanes);
+                    }
+                }
+                else
+                {
+                    // Coherent rays agree on the near child, so the first lane
+                    // picks it for all of them.
+                    if (packet.DirectionNegative(std::countr_zero(lanes), node.axis))
+                    {
+                        stack[stack_size++] = { current.node + 1, lanes };
+                        current = { node.offset, lanes };
+                    }
+                    else
+                    {
+                        stack[stack_size++] = { node.offset, lanes };
+                        current = { current.node + 1, lanes };
+                    }
+                    continue;
+                }
+            }
+
+            if (stack_size == 0)
+            {
+                break;
+            }
+            current = stack[--stack_size];
+        }
+
+        return hit_lanes;
+    }
+
+private:
+    // Only alive during `Build()`.
+    std::vector<Point3>   centroids;
+    std::vector<uint32_t> scratch;       // Room for `Partition()` to copy `indices` into.
+    TaskPool*             pool = nullptr;
+
+    BVHStats stats;
+
+    template <bool any_hit, typename IntersectPrimitive>
+    bool Walk(const Ray& ray, Interval ray_t, IntersectPrimitive& intersect) const
+    {
+        if (this->nodes.empty())
+        {
+            return false;
+        }
+
+        const Point3& origin = ray.Origin();
+        const Vec3 inv_direction(1 / ray.Direction().x(), 1 / ray.Direction().y(), 1 / ray.Direction().z());
+        const bool direction_negative[3] = { inv_direction.x() < 0, inv_direction.y() < 0, inv_direction.z() < 0 };
+
+        uint32_t stack[max_depth];
+        int stack_size = 0;
+        uint32_t current = 0;
+
+        bool hit_anything = false;
+
+        while (true)
+        {
+            const BVHNode& node = this->nodes[current];
+
+            if (node.bounds.ToAABB().Hit(origin, inv_direction, ray_t))
+            {
+                if (node.IsLeaf())
+                {
+                    for (uint32_t i = 0; i < node.primitive_count; ++i)
+                    {
+                        if (intersect(this->indices[node.offset + i], ray_t))
+                        {
+                            if constexpr (any_hit)
+                            {
+                                return true;
+                            }
+                            hit_anything = true;
+                        }
+                    }
+                }
+                else
+                {
+                    // Visit the child that is closer along the ray first, its hits
+                    // shorten the interval for the other one.
+                    if (direction_negative[node.axis])
+                    {
+                        stack[stack_size++] = current + 1;
+                        current = node.offset;
+                    }
+                    else
+                    {
+                        stack[stack_size++] = node.offset;
+                        current = current + 1;
+                    }
+                    continue;
+                }
+            }
+
+            if (stack_size == 0)
+            {
+                break;
+            }
+            current = stack[--stack_size];
+        }
+
+        return hit_anything;
+    }
+
+    struct Bin
+    {
+        AABB bbox = AABB::Empty;
+        uint32_t count = 0;
+    };
+
+    static Point3 Centroid(const AABB& bbox)
+    {
+        return 0.5 * Point3(
+            bbox.x.min + bbox.x.max,
+            bbox.y.min + bbox.y.max,
+            bbox.z.min + bbox.z.max
+        );
+    }
+
+    // Builds the subtree over `indices[begin, end)` and appends it to `out` in
+    // depth-first order. Returns the index of the subtree root within `out`.
+    uint32_t BuildRecursive(
+        const std::vector<AABB>& primitive_boxes,
+        const BVHSplitMethod method,
+        const uint32_t begin, const uint32_t end,
+        const int depth,
+        const int forks_left,
+        std::vector<BVHNode>& out)
+    {
+        const uint32_t node_index = (uint32_t)out.size();
+        out.emplace_back();
+
+        AABB bbox, centroid_bbox;
+        ComputeBounds(primitive_boxes, begin, end, bbox, centroid_bbox);
+
+        out[node_index].bounds = BVHBounds(bbox);
+
+        const uint32_t primitive_count = end - begin;
+
+        int axis = centroid_bbox.LongestAxis();
+        uint32_t mid = begin + primitive_count / 2;
+
+        // The median split adds at most log2(n) <= 32 levels, so switching to it
+        // halfway down keeps every tree within the traversal stack.
+        const bool use_sah = method == BVHSplitMethod::SAH && depth < max_depth / 2;
+
+        if (use_sah)
+        {
+            if (SplitSAH(primitive_boxes, bbox, centroid_bbox, begin, end, axis, mid) == false)
+            {
+                // Making a leaf is cheaper than any split.
+                MakeLeaf(out[node_index], begin, end);
+                return node_index;
+            }
+        }
+        else
+        {
+            if (primitive_count <= max_leaf_primitives)
+            {
+                MakeLeaf(out[node_index], begin, end);
+                return node_index;
+            }
+
+            // Median split along the longest axis of the centroid bounds.
+            std::nth_element(
+                std::begin(this->indices) + begin,
+                std::begin(this->indices) + mid,
+                std::begin(this->indices) + end,
+                [this, axis](const uint32_t a, const uint32_t b)
+                {
+                    return this->centroids[a][axis] < this->centroids[b][axis];
+                }
+            );
+        }
+
+        uint32_t second_child = 0;
+
+        if (forks_left > 0 && primitive_count >= parallel_build_cutoff)
+        {
+            // Both halves work on disjoint ranges of `indices`, so they can be built
+            // concurrently into their own node arrays and spliced in afterwards.
+            std::vector<BVHNode> left_nodes;
+            std::vector<BVHNode> right_nodes;
+
+            TaskPool::Group left;
+            this->pool->Run(left, [&]()
+            {
+                BuildRecursive(primitive_boxes, method, begin, mid, depth + 1, forks_left - 1, left_nodes);
+            });
+            BuildRecursive(primitive_boxes, method, mid, end, depth + 1, forks_left - 1, right_nodes);
+            this->pool->Wait(left);
+
+            AppendSubtree(out, left_nodes);
+            second_child = (uint32_t)out.size();
+            AppendSubtree(out, right_nodes);
+        }
+        else
+        {
+            BuildRecursive(primitive_boxes, method, begin, mid, depth + 1, 0, out);
+            second_child = BuildRecursive(primitive_boxes, method, mid, end, depth + 1, 0, out);
+        }
+
+        // `out` may have been reallocated by the recursive calls.
+        out[node_index].offset = second_child;
+        out[node_index].axis = (uint16_t)axis;
+
+        return node_index;
+    }
+
+    static void MakeLeaf(BVHNode& node, const uint32_t begin, const uint32_t end)
+    {
+        node.offset = begin;
+        node.primitive_count = (uint16_t)(end - begin);
+    }
+
+    static void AppendSubtree(std::vector<BVHNode>& out, const std::vector<BVHNode>& subtree)
+    {
+        // Child offsets of the subtree are relative to its own array. Leaf offsets
+        // point into `indices` and stay as they are.
+        const uint32_t base = (uint32_t)out.size();
+
+        for (BVHNode node : subtree)
+        {
+            if (node.IsLeaf() == false)
+            {
+                node.offset += base;
+            }
+            out.push_back(node);
+        }
+    }
+
+    // Chunks `[begin, end)` is split into: one per `parallel_build_cutoff`
+    // primitives, at most one per thread.
+    uint32_t ChunkCount(const uint32_t begin, const uint32_t end) const
+    {
+        if (this->pool == nullptr)
+        {
+            return 1;
+        }
+
+        return std::clamp((end - begin) / parallel_build_cutoff, 1u, (uint32_t)this->pool->ThreadCount());
+    }
+
+    // Runs `function(chunk, chunk_begin, chunk_end)` for `chunk_count` equal
+    // chunks of `[begin, end)` on the pool.
+    template <typename Function>
+    void ForEachChunk(const uint32_t begin, const uint32_t end, const uint32_t chunk_count, Function&& function) const
+    {
+        if (chunk_count <= 1)
+        {
+            function(0u, begin, end);
+            return;
+        }
+
+        this->pool->ForEachChunk(begin, end, chunk_count, [&function](const size_t chunk, const size_t chunk_begin, const size_t chunk_end)
+        {
+            function((uint32_t)chunk, (uint32_t)chunk_begin, (uint32_t)chunk_end);
+        });
+    }
+
+    // Runs `function(chunk_begin, chunk_end)` over `[begin, end)`, split into
+    // chunks when the range is large enough to be worth it.
+    template <typename Function>
+    void ParallelFor(const uint32_t begin, const uint32_t end, Function&& function) const
+    {
+        ForEachChunk(begin, end, ChunkCount(begin, end), [&function](const uint32_t, const uint32_t chunk_begin, const uint32_t chunk_end)
+        {
+            function(chunk_begin, chunk_end);
+        });
+    }
+
+    // Moves the entries of `indices[begin, end)` for which `goes_left` holds to
+    // the front and returns where the others start. Large ranges count each
+    // chunk's entries first, then copy every chunk to its place in `scratch` and
+    // back, all in parallel. That keeps the order on both sides, so the tree is
+    // the same for any number of threads.
+    template <typename Predicate>
+    uint32_t Partition(const uint32_t begin, const uint32_t end, Predicate&& goes_left)
+    {
+        if (end - begin < parallel_build_cutoff)
+        {
+            return (uint32_t)(std::partition(std::begin(this->indices) + begin, std::begin(this->indices) + end, goes_left) - std::begin(this->indices));
+        }
+
+        const uint32_t chunk_count = ChunkCount(begin, end);
+
+        std::vector<uint32_t> left_counts(chunk_count, 0);
+        ForEachChunk(begin, end, chunk_count, [&](const uint32_t chunk, const uint32_t chunk_begin, const uint32_t chunk_end)
+        {
+            uint32_t count = 0;
+            for (uint32_t i = chunk_begin; i < chunk_end; ++i)
+            {
+                count += goes_left(this->indices[i]) ? 1 : 0;
+            }
+            left_counts[chunk] = count;
+        });
+
+        uint32_t mid = begin;
+        for (const uint32_t count : left_counts)
+        {
+            mid += count;
+        }
+
+        ForEachChunk(begin, end, chunk_count, [&](const uint32_t chunk, const uint32_t chunk_begin, const uint32_t chunk_end)
+        {
+            // Where this chunk's entries go on either side.
+            uint32_t left = begin;
+            for (uint32_t c = 0; c < chunk; ++c)
+            {
+                left += left_counts[c];
+            }
+            uint32_t right = mid + (chunk_begin - begin) - (left - begin);
+
+            for (uint32_t i = chunk_begin; i < chunk_end; ++i)
+            {
+                const uint32_t index = this->indices[i];
+                this->scratch[goes_left(index) ? left++ : right++] = index;
+            }
+        });
+
+        ParallelFor(begin, end, [this](const uint32_t chunk_begin, const uint32_t chunk_end)
+        {
+            std::copy(std::begin(this->scratch) + chunk_begin, std::begin(this->scratch) + chunk_end, std::begin(this->indices) + chunk_begin);
+        });
+
+        return mid;
+    }
+
+    void ComputeBounds(
+        const std::vector<AABB>& primitive_boxes,
+        const uint32_t begin, const uint32_t end,
+        AABB& bbox, AABB& centroid_bbox) const
+    {
+        std::mutex mutex;
+        bbox = AABB::Empty;
+        centroid_bbox = AABB::Empty;
+
+        ParallelFor(begin, end, [&](const uint32_t chunk_begin, const uint32_t chunk_end)
+        {
+            AABB chunk_bbox = AABB::Empty;
+            AABB chunk_centroid_bbox = AABB::Empty;
+            for (uint32_t i = chunk_begin; i < chunk_end; ++i)
+            {
+                const Point3& centroid = this->centroids[this->indices[i]];
+                chunk_bbox = AABB(chunk_bbox, primitive_boxes[this->indices[i]]);
+                chunk_centroid_bbox = AABB(chunk_centroid_bbox, AABB(centroid, centroid));
+            }
+
+            // Unions are exact, so merging in any order gives the same bounds.
+            std::lock_guard<std::mutex> lock(mutex);
+            bbox = AABB(bbox, chunk_bbox);
+            centroid_bbox = AABB(centroid_bbox, chunk_centroid_bbox);
+        });
+    }
+
+    // Bins the centroids along every axis and picks the plane with the lowest SAH
+    // cost. Returns false if a leaf is the better choice, otherwise partitions
+    // `indices` and reports the split through `axis` and `mid`.
+    bool SplitSAH(
+        const std::vector<AABB>& primitive_boxes,
+        const AABB& bbox, const AABB& centroid_bbox,
+        const uint32_t begin, const uint32_t end,
+        int& axis, uint32_t& mid)
+    {
+        const uint32_t primitive_count = end - begin;
+        if (primitive_count == 1)
+        {
+            return false;
+        }
+
+        const double leaf_cost = intersection_cost * primitive_count;
+        const double inv_area = 1.0 / bbox.SurfaceArea();
+
+        double bin_scale[3];
+        for (int a = 0; a < 3; ++a)
+        {
+            const double size = centroid_bbox.AxisInterval(a).Size();
+            bin_scale[a] = size > 0 ? sah_bin_count / size : 0;
+        }
+
+        // One pass bins all three axes. Large ranges bin per chunk and merge.
+        std::mutex mutex;
+        Bin bins[3][sah_bin_count];
+
+        ParallelFor(begin, end, [&](const uint32_t chunk_begin, const uint32_t chunk_end)
+        {
+            Bin chunk_bins[3][sah_bin_count];
+            for (uint32_t i = chunk_begin; i < chunk_end; ++i)
+            {
+                const Point3& centroid = this->centroids[this->indices[i]];
+                const AABB& box = primitive_boxes[this->indices[i]];
+
+                for (int a = 0; a < 3; ++a)
+                {
+                    Bin& bin = chunk_bins[a][BinIndex(centroid[a], centroid_bbox.AxisInterval(a).min, bin_scale[a])];
+                    bin.count++;
+                    bin.bbox = AABB(bin.bbox, box);
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            for (int a = 0; a < 3; ++a)
+            {
+                for (int b = 0; b < sah_bin_count; ++b)
+                {
+                    bins[a][b].count += chunk_bins[a][b].count;
+                    bins[a][b].bbox = AABB(bins[a][b].bbox, chunk_bins[a][b].bbox);
+                }
+            }
+        });
+
+        double best_cost = infinity;
+        int best_axis = -1;
+        int best_split = 0;
+
+        for (int a = 0; a < 3; ++a)
+        {
+            if (bin_scale[a] == 0)
+            {
+                continue;
+            }
+
+            // Sweep from the right to get the area and count above every plane,
+            // then from the left to evaluate the cost of each plane.
+            double right_area[sah_bin_count];
+            uint32_t right_count[sah_bin_count];
+
+            AABB accumulated = AABB::Empty;
+            uint32_t count = 0;
+            for (int b = sah_bin_count - 1; b > 0; --b)
+            {
+                accumulated = AABB(accumulated, bins[a][b].bbox);
+                count += bins[a][b].count;
+                right_area[b] = count > 0 ? accumulated.SurfaceArea() : 0;
+                right_count[b] = count;
+            }
+
+            accumulated = AABB::Empty;
+            count = 0;
+            for (int b = 1; b < sah_bin_count; ++b)
+            {
+                accumulated = AABB(accumulated, bins[a][b - 1].bbox);
+                count += bins[a][b - 1].count;
+
+                if (count == 0 || right_count[b] == 0)
+                {
+                    continue;
+                }
+
+                const double cost = traversal_cost + intersection_cost * inv_area *
+                    (count * accumulated.SurfaceArea() + right_count[b] * right_area[b]);
+
+                if (cost < best_cost)
+                {
+                    best_cost = cost;
+                    best_axis = a;
+                    best_split = b;
+                }
+            }
+        }
+
+        if (best_axis < 0)
+        {
+            // All centroids coincide. Nothing to split on unless the leaf would be
+            // too large, in which case an arbitrary halving has to do.
+            if (primitive_count <= max_sah_leaf_primitives)
+            {
+                return false;
+            }
+
+            axis = 0;
+            mid = begin + primitive_count / 2;
+            return true;
+        }
+
+        if (primitive_count <= max_sah_leaf_primitives && leaf_cost <= best_cost)
+        {
+            return false;
+        }
+
+        const double min = centroid_bbox.AxisInterval(best_axis).min;
+        const double scale = bin_scale[best_axis];
+
+        mid = Partition(begin, end, [&](const uint32_t index)
+        {
+            return BinIndex(this->centroids[index][best_axis], min, scale) < best_split;
+        });
+
+        axis = best_axis;
+        return true;
+    }
+
+    static int BinIndex(const double value, const double min, const double scale)
+    {
+        const int b = int((value - min) * scale);
+        return std::clamp(b, 0, sah_bin_count - 1);
+    }
+
+    void ComputeStats()
+    {
+        const double inv_root_area = 1.0 / this->nodes[0].bounds.ToAABB().SurfaceArea();
+
+        this->stats.node_count = this->nodes.size();
+
+        // Depth is tracked with the same explicit stack that traversal uses.
+        std::pair<uint32_t, int> stack[max_depth];
+        int stack_size = 0;
+        stack[stack_size++] = { 0, 1 };
+
+        while (stack_size > 0)
+        {
+            const auto [index, depth] = stack[--stack_size];
+            const BVHNode& node = this->nodes[index];
+            const double relative_area = node.bounds.ToAABB().SurfaceArea() * inv_root_area;
+
+            this->stats.depth = std::max(this->stats.depth, depth);
+
+            if (node.IsLeaf())
+            {
+                this->stats.leaf_count++;
+                this->stats.sah_cost += relative_area * intersection_cost * node.primitive_count;
+            }
+            else
+            {
+                this->stats.sah_cost += relative_area * traversal_cost;
+                stack[stack_size++] = { index + 1, depth + 1 };
+                stack[stack_size++] = { node.offset, depth + 1 };
+            }
+        }
+    }
+};
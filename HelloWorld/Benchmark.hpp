@@ -0,0 +1,447 @@
+#pragma once
+
+// Microbenchmarks, run from the command line (see `main()`).
+
+#include "RTWeekend.hpp"
+
+#include "Hit_TriangleMesh.hpp"
+#include "Hittable.hpp"
+#include "Interval.hpp"
+#include "Material.hpp"
+#include "Ray.hpp"
+#include "RayPacket.hpp"
+#include "Triangle.hpp"
+#include "Vec2.hpp"
+#include "Vec3.hpp"
+
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Calls `pass()` once untimed to warm the caches up and then `passes` more
+// times, and prints the time per operation, for `operations` operations per
+// pass, followed by what the last pass returned (hit counts, checksums).
+template <typename Pass>
+inline void TimeBenchmark(std::ostream& out, const char* name, const char* unit, const double operations, const int passes, Pass&& pass)
+{
+    auto result = pass();
+
+    const auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < passes; ++i)
+    {
+        result = pass();
+    }
+    const auto end = std::chrono::high_resolution_clock::now();
+
+    const double nanoseconds = std::chrono::duration<double, std::nano>(end - start).count();
+
+    out << name << ": " << nanoseconds / (double(passes) * operations) << " ns/" << unit << ", " << result << "\n";
+}
+
+// Joins `values` into the string a benchmark pass returns.
+template <typename... Values>
+inline std::string BenchmarkResult(const Values&... values)
+{
+    std::ostringstream stream;
+    (stream << ... << values);
+    return stream.str();
+}
+
+// The triangle test `Hit_Tri` used while it went through `Hit_Quad::Hit`: plane
+// intersection, an inside test on the plane coordinates, and then a second full
+// barycentric solve for the UVs. Kept here only as the baseline to compare with.
+// `normal`, `d` and `w` are precomputed per triangle, as `Hit_Quad` does.
+inline bool LegacyTriangleHit(
+    const Ray& ray, const Interval ray_t,
+    const Point3& q, const Vec3& u, const Vec3& v,
+    const Vec3& normal, const double d, const Vec3& w,
+    const Vec2 uv[3],
+    HitRecord& hit_record)
+{
+    const double denominator = Dot(normal, ray.Direction());
+    if (std::abs(denominator) < 1e-8)
+    {
+        return false;
+    }
+
+    const double t = (d - Dot(normal, ray.Origin())) / denominator;
+    if (ray_t.Contains(t) == false)
+    {
+        return false;
+    }
+
+    const Point3 intersection = ray.At(t);
+    const Vec3 planar_intersection = intersection - q;
+    const double alpha = Dot(w, Cross(planar_intersection, v));
+    const double beta  = Dot(w, Cross(u, planar_intersection));
+
+    if (alpha < 0 || beta < 0 || alpha + beta > 1)
+    {
+        return false;
+    }
+
+    const Vec3 v0 = u;
+    const Vec3 v1 = v;
+    const Vec3 v2 = intersection - q;
+
+    const double d00 = Dot(v0, v0);
+    const double d01 = Dot(v0, v1);
+    const double d11 = Dot(v1, v1);
+    const double d20 = Dot(v2, v0);
+    const double d21 = Dot(v2, v1);
+
+    const double denom = d00 * d11 - d01 * d01;
+
+    const double bv = (d11 * d20 - d01 * d21) / denom;
+    const double bw = (d00 * d21 - d01 * d20) / denom;
+    const double bu = 1 - bv - bw;
+
+    const Vec2 uv_p = bu * uv[0] + bv * uv[1] + bw * uv[2];
+
+    hit_record.t = t;
+    hit_record.point = intersection;
+    hit_record.SetFaceNormal(ray, normal);
+    hit_record.u = uv_p.x();
+    hit_record.v = uv_p.y();
+
+    return true;
+}
+
+// Tests every ray against every triangle of a random soup with the old path and
+// the new kernel, and reports the time per test and the number of hits.
+inline void BenchmarkTriangleIntersection(std::ostream& out)
+{
+    constexpr int triangle_count = 1024;
+    constexpr int ray_count = 4096;
+    constexpr int repetitions = 4;
+
+    std::mt19937 generator(1234);
+    std::uniform_real_distribution<double> distribution(-1, 1);
+    const auto random_point = [&]() { return Point3(distribution(generator), distribution(generator), distribution(generator)); };
+
+    const std::vector<Vec2> uv = { Vec2(0, 0), Vec2(1, 0), Vec2(0, 1) };
+
+    // Every triangle as Q, u, v (the way `Hit_Tri` stores it) and as a `Hit_Tri`.
+    std::vector<Point3> qs, us, vs;
+    std::vector<Vec3> normals, ws;
+    std::vector<double> ds;
+    std::vector<Hit_Tri> triangles;
+    triangles.reserve(triangle_count);
+    for (int i = 0; i < triangle_count; ++i)
+    {
+        qs.push_back(random_point());
+        us.push_back(0.25 * random_point());
+        vs.push_back(0.25 * random_point());
+        triangles.emplace_back(qs.back(), us.back(), vs.back(), uv, nullptr);
+
+        const Vec3 n = Cross(us.back(), vs.back());
+        normals.push_back(UnitVector(n));
+        ds.push_back(Dot(normals.back(), qs.back()));
+        ws.push_back(n / Dot(n, n));
+    }
+
+    std::vector<Ray> rays;
+    for (int i = 0; i < ray_count; ++i)
+    {
+        const Point3 origin = 3 * random_point();
+        rays.emplace_back(origin, random_point() - origin);
+    }
+
+    const auto run = [&](const char* name, auto&& test)
+    {
+        TimeBenchmark(out, name, "test", double(ray_count) * triangle_count, repetitions, [&]()
+        {
+            uint64_t hits = 0;
+            double checksum = 0;
+            for (int i = 0; i < ray_count; ++i)
+            {
+                for (int j = 0; j < triangle_count; ++j)
+                {
+                    HitRecord hit_record;
+                    if (test(i, j, hit_record))
+                    {
+                        ++hits;
+                        checksum += hit_record.u + hit_record.v;
+                    }
+                }
+            }
+            return BenchmarkResult(hits, " hits, uv checksum ", checksum);
+        });
+    };
+
+    const Interval ray_t(0.001, infinity);
+
+    run("Hit_Quad::Hit + Hit_Tri::_Hit", [&](const int i, const int j, HitRecord& hit_record)
+    {
+        return LegacyTriangleHit(rays[i], ray_t, qs[j], us[j], vs[j], normals[j], ds[j], ws[j], uv.data(), hit_record);
+    });
+
+    run("Moller-Trumbore, Hit_Tri::Hit", [&](const int i, const int j, HitRecord& hit_record)
+    {
+        return triangles[j].Hit(rays[i], ray_t, hit_record);
+    });
+
+    // What the leaf loop of `Hit_TriangleMesh` does per face: no HitRecord, only
+    // the distance and barycentrics.
+    run("Moller-Trumbore, kernel only", [&](const int i, const int j, HitRecord& hit_record)
+    {
+        real t, b1, b2;
+        if (IntersectTriangle(rays[i], ray_t, qs[j], us[j], vs[j], t, b1, b2) == false)
+        {
+            return false;
+        }
+
+        hit_record.u = b1;
+        hit_record.v = b2;
+        return true;
+    });
+}
+
+// Draws the same amount of numbers from a freshly constructed distribution on a
+// shared `std::mt19937` (what `RandomDouble` used to do) and from `Pcg32`.
+inline void BenchmarkRandom(std::ostream& out)
+{
+    constexpr int count = 1 << 26;
+
+    const auto run = [&](const char* name, auto&& next)
+    {
+        TimeBenchmark(out, name, "number", count, 1, [&]()
+        {
+            double sum = 0;
+            for (int i = 0; i < count; ++i)
+            {
+                sum += next();
+            }
+            return BenchmarkResult("mean ", sum / count);
+        });
+    };
+
+    std::mt19937 mt(1234);
+    run("std::mt19937 + uniform_real_distribution", [&]()
+    {
+        std::uniform_real_distribution<double> distribution(0, 1);
+        return distribution(mt);
+    });
+
+    Pcg32 pcg(1234);
+    run("Pcg32::NextDouble", [&]() { return pcg.NextDouble(); });
+    run("Pcg32::NextFloat", [&]() { return double(pcg.NextFloat()); });
+
+    SeedRandom(1234);
+    run("RandomDouble (thread_local Pcg32)", [&]() { return RandomDouble(); });
+}
+
+// Shoots the same segments, like shadow rays between two points in the scene,
+// through a triangle soup and a BVH of spheres with `Hit()` and `Occluded()`, and
+// reports the time per ray and how many were blocked.
+inline void BenchmarkOcclusion(std::ostream& out)
+{
+    constexpr int triangle_count = 200000;
+    constexpr int sphere_count = 20000;
+    constexpr int ray_count = 200000;
+
+    std::mt19937 generator(1234);
+    std::uniform_real_distribution<double> distribution(-1, 1);
+    const auto random_point = [&]() { return Point3(distribution(generator), distribution(generator), distribution(generator)); };
+
+    const shared_ptr<Material> material = make_shared<Mat_Lambertian>(Color(0.5, 0.5, 0.5));
+
+    auto mesh = make_shared<MeshData>();
+    mesh->materials.push_back(material);
+    for (uint32_t i = 0; i < triangle_count; ++i)
+    {
+        const Point3 p = random_point();
+        mesh->positions.push_back(p);
+        mesh->positions.push_back(p + 0.02 * random_point());
+        mesh->positions.push_back(p + 0.02 * random_point());
+        mesh->indices.insert(mesh->indices.end(), { 3 * i, 3 * i + 1, 3 * i + 2 });
+        mesh->material_ids.push_back(0);
+    }
+    const Hit_TriangleMesh triangles(mesh);
+
+    Hit_List sphere_list;
+    for (int i = 0; i < sphere_count; ++i)
+    {
+        sphere_list.Add(make_shared<Hit_Sphere>(random_point(), 0.01, material));
+    }
+    const Hit_LinearBVH spheres(sphere_list);
+
+    std::vector<Ray> rays;
+    for (int i = 0; i < ray_count; ++i)
+    {
+        const Point3 origin = random_point();
+        rays.emplace_back(origin, random_point() - origin);
+    }
+
+    const Interval segment(0.001, 0.999);
+
+    const auto run = [&](const char* name, auto&& test)
+    {
+        TimeBenchmark(out, name, "ray", ray_count, 1, [&]()
+        {
+            uint64_t blocked = 0;
+            for (const Ray& ray : rays)
+            {
+                if (test(ray))
+                {
+                    ++blocked;
+                }
+            }
+            return BenchmarkResult(blocked, " blocked");
+        });
+    };
+
+    run("Hit_TriangleMesh::Hit", [&](const Ray& ray)
+    {
+        HitRecord hit_record;
+        return triangles.Hit(ray, segment, hit_record);
+    });
+    run("Hit_TriangleMesh::Occluded", [&](const Ray& ray) { return triangles.Occluded(ray, segment); });
+
+    run("Hit_LinearBVH of spheres, Hit", [&](const Ray& ray)
+    {
+        HitRecord hit_record;
+        return spheres.Hit(ray, segment, hit_record);
+    });
+    run("Hit_LinearBVH of spheres, Occluded", [&](const Ray& ray) { return spheres.Occluded(ray, segment); });
+}
+
+// Times the hot vector operations over arrays of random vectors. Build once
+// with and once without RT_USE_SIMD (see Vec3.hpp), or RT_USE_FLOAT (see
+// RTWeekend.hpp), to compare them.
+inline void BenchmarkVectorMath(std::ostream& out)
+{
+    constexpr int count = 1 << 16;
+    constexpr int repetitions = 64;
+
+    out << "Vec3: " << (RT_SIMD_VEC3 ? "AVX2" : "scalar") << " " << (sizeof(real) == sizeof(float) ? "float" : "double")
+        << ", " << sizeof(Vec3) << " bytes\n";
+
+    std::mt19937 generator(1234);
+    std::uniform_real_distribution<double> distribution(-1, 1);
+    const auto random_vector = [&]() { return Vec3(distribution(generator), distribution(generator), distribution(generator)); };
+
+    std::vector<Vec3> a(count), b(count);
+    for (int i = 0; i < count; ++i)
+    {
+        a[i] = random_vector();
+        b[i] = UnitVector(random_vector());
+    }
+
+    const auto run = [&](const char* name, auto&& operation)
+    {
+        TimeBenchmark(out, name, "op", count, repetitions, [&]()
+        {
+            Vec3 sum;
+            for (int i = 0; i < count; ++i)
+            {
+                sum += operation(a[i], b[i]);
+            }
+            return BenchmarkResult("checksum ", sum);
+        });
+    };
+
+    run("Dot", [](const Vec3& u, const Vec3& v) { return Vec3(Dot(u, v), 0, 0); });
+    run("Cross", [](const Vec3& u, const Vec3& v) { return Cross(u, v); });
+    run("UnitVector", [](const Vec3& u, const Vec3& v) { return UnitVector(u); });
+    run("Reflect", [](const Vec3& u, const Vec3& v) { return Reflect(u, v); });
+    run("Refract", [](const Vec3& u, const Vec3& v) { return Refract(UnitVector(u), v, 0.67); });
+    run("Color multiply-add", [](const Vec3& u, const Vec3& v) { return u * v + 0.5 * u; });
+}
+
+// Traces the camera rays of an image through a finely tessellated sphere, once
+// one at a time and once in packets of horizontally neighbouring pixels, the
+// way `Camera` groups them.
+inline void BenchmarkPacketTraversal(std::ostream& out)
+{
+    constexpr int rings = 256;
+    constexpr int segments = 512;
+    constexpr int image_size = 512;
+    constexpr int repetitions = 4;
+
+    auto mesh = make_shared<MeshData>();
+    mesh->materials.push_back(make_shared<Mat_Lambertian>(Color(0.5, 0.5, 0.5)));
+
+    for (int ring = 0; ring <= rings; ++ring)
+    {
+        const real theta = pi * ring / rings;
+        for (int segment = 0; segment < segments; ++segment)
+        {
+            const real phi = 2 * pi * segment / segments;
+            mesh->positions.push_back(Point3(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi)));
+        }
+    }
+
+    for (uint32_t ring = 0; ring < rings; ++ring)
+    {
+        for (uint32_t segment = 0; segment < segments; ++segment)
+        {
+            const uint32_t i0 = ring * segments + segment;
+            const uint32_t i1 = ring * segments + (segment + 1) % segments;
+            const uint32_t i2 = i0 + segments;
+            const uint32_t i3 = i1 + segments;
+
+            mesh->indices.insert(mesh->indices.end(), { i0, i2, i1, i1, i2, i3 });
+            mesh->material_ids.insert(mesh->material_ids.end(), { 0, 0 });
+        }
+    }
+
+    const Hit_List world(make_shared<Hit_TriangleMesh>(mesh));
+
+    // A pinhole camera at z = 3 that sees the whole sphere.
+    std::vector<Ray> rays;
+    for (int y = 0; y < image_size; ++y)
+    {
+        for (int x = 0; x < image_size; ++x)
+        {
+            const real u = (x + real(0.5)) / image_size * 2 - 1;
+            const real v = 1 - (y + real(0.5)) / image_size * 2;
+            rays.emplace_back(Point3(0, 0, 3), Vec3(u * real(0.5), v * real(0.5), -1));
+        }
+    }
+
+    out << mesh->FaceCount() << " triangles, " << rays.size() << " camera rays, packets of " << RayPacket::size << "\n";
+
+    const auto run = [&](const char* name, auto&& trace)
+    {
+        TimeBenchmark(out, name, "ray", double(rays.size()), repetitions, [&]()
+        {
+            uint64_t hits = 0;
+            for (size_t i = 0; i < rays.size(); i += RayPacket::size)
+            {
+                hits += trace(i);
+            }
+            return BenchmarkResult(hits, " hits");
+        });
+    };
+
+    run("Hittable::Hit", [&](const size_t first)
+    {
+        int hits = 0;
+        for (int lane = 0; lane < RayPacket::size; ++lane)
+        {
+            HitRecord hit_record;
+            hits += world.Hit(rays[first + lane], Interval(0, infinity), hit_record);
+        }
+        return hits;
+    });
+
+    run("Hittable::HitPacket", [&](const size_t first)
+    {
+        RayPacket packet;
+        for (int lane = 0; lane < RayPacket::size; ++lane)
+        {
+            packet.SetLane(lane, rays[first + lane], Interval(0, infinity));
+        }
+
+        HitRecord hit_records[RayPacket::size];
+        return std::popcount(world.HitPacket(packet, (1u << RayPacket::size) - 1, hit_records));
+    });
+}
@@ -13,15 +13,25 @@
 #include "Interval.hpp"
 #include "Material.hpp"
 #include "Ray.hpp"
+#include "RayPacket.hpp"
 #include "Vec3.hpp"
 #include "Util.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <barrier>
+#include <chrono>
 #include <cmath>
 #include <cstdint>
+#include <functional>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <SDL3/SDL_pixels.h>
+#include <SDL3/SDL_rect.h>
 #include <SDL3/SDL_render.h>
 #include <SDL3/SDL_stdinc.h>
 
@@ -37,93 +47,232 @@ public:
     Vec3   direction    = Vec3(0, 0, -1);
     Vec3   direction_up = Vec3(0, 1, 0);    // Camera-relative "up" direction
 
-    double fov_vertical = 90;  // Vertical view angle (field of view)
+    real fov_vertical = 90;  // Vertical view angle (field of view)
 
-    double defocus_angle  = 0;   // Variation angle of rays through each pixel
-    double focus_distance = 10;  // Distance from camera origin to plane of perfect focus
+    real defocus_angle  = 0;   // Variation angle of rays through each pixel
+    real focus_distance = 10;  // Distance from camera origin to plane of perfect focus
 
     int samples_per_pixel = 10;  // Count of random samples for each pixel
     int max_depth         = 10;  // Maximum number of ray bounces into scene
 
+    int russian_roulette_depth = 3;  // Bounces before Russian roulette may end a path
+
+    bool light_sampling = true;  // Sample a light directly at every diffuse hit (next-event estimation)
+    bool ray_packets    = true;  // Trace the camera rays of neighbouring pixels together (see `RayPacket`)
+    bool wavefront      = false; // Advance all paths of a tile together, stage by stage (see `RenderTileWavefront()`)
+
+    // Progressive mode adds one sample per pixel per pass and shows the running
+    // average after every pass. It stops at `samples_per_pixel` (0 means never),
+    // when `time_budget` seconds (0 means no limit) have passed, or when stopped.
+    bool   progressive = false;
+    double time_budget = 0;
+
+    // Adaptive sampling stops sampling a pixel once the standard error of its
+    // mean, measured on the displayed (gamma corrected) luminance, falls below
+    // `adaptive_threshold`. 0 turns it off. `samples_per_pixel` stays the cap.
+    double adaptive_threshold   = 0;
+    int    adaptive_min_samples = 16;  // Samples before a pixel's estimate is trusted
+
     Color background;  // Scene background color
 
-    SDL_Surface* surface = nullptr;
+    int thread_count = 0;   // Render worker threads, 0 means one per hardware thread
+    int tile_size    = 32;  // Edge length of the square tiles handed out to workers
+
     SDL_Texture* texture = nullptr;
 
     Camera() {}
 
-    void Render(const Hittable& world, SDL_Renderer* renderer)
+    ~Camera()
+    {
+        this->Cancel();
+    }
+
+    const Image& GetImage() const
+    {
+        return this->image;
+    }
+
+    // Renders into `image` on the worker threads and returns when it is done. Does
+    // not touch SDL, so it also works without a window.
+    void Render(const Hittable& world)
+    {
+        this->StartRender(world);
+        this->Wait();
+    }
+
+    // Same with the lights of `world` collected beforehand (see `Scene`).
+    void Render(const Hittable& world, const Hit_List& lights)
+    {
+        this->StartRender(world, lights);
+        this->Wait();
+    }
+
+    // Starts rendering on the worker threads and returns immediately. `world` has
+    // to stay alive until the render is finished, cancelled or waited for.
+    void StartRender(const Hittable& world)
     {
-        if (this->surface != nullptr)
+        Hit_List lights;
+        if (this->light_sampling)
         {
-            SDL_DestroySurface(this->surface);
-            this->surface = nullptr;
-            this->texture = nullptr;
+            world.CollectLights(lights);
         }
 
-        this->Initialize();
+        this->StartRender(world, lights);
+    }
 
-        this->surface = SDL_CreateSurface(
-            this->image_width,
-            this->image_height,
-            SDL_PIXELFORMAT_RGBA32
-        );
+    // Same with the lights of `world` collected beforehand, so renders of the
+    // same world do not gather them again.
+    void StartRender(const Hittable& world, const Hit_List& lights)
+    {
+        this->Cancel();
+        this->StartWorkers(world, lights);
+    }
 
-        for (int h = 0; h < this->image_height; ++h)
-        {
-            for (int w = 0; w < this->image_width; ++w)
-            {
-                Color pixel_color(0, 0, 0);
+    bool IsRendering() const
+    {
+        return this->workers_running.load(std::memory_order_acquire) > 0;
+    }
 
-                for (size_t sample = 0; sample < this->samples_per_pixel; ++sample)
-                {
-                    const Ray ray = this->GetRay(w, h);
-                    pixel_color += RayColor(ray, this->max_depth, world);
-                }
+    uint64_t SamplesTaken() const
+    {
+        return this->samples_taken.load(std::memory_order_relaxed);
+    }
 
-                pixel_color *= this->pixel_samples_scale;
+    double AverageSamplesPerPixel() const
+    {
+        return double(this->SamplesTaken()) / (double(this->image_width) * this->image_height);
+    }
 
-                static const Interval intensity(0.000, 0.999);
+    // Asks the workers to stop after the tiles they are on, without waiting.
+    void RequestStop()
+    {
+        this->stop_requested = true;
+    }
 
-                const double r = intensity.Clamp(LinearToGamma(pixel_color.x()));
-                const double g = intensity.Clamp(LinearToGamma(pixel_color.y()));
-                const double b = intensity.Clamp(LinearToGamma(pixel_color.z()));
+    // Blocks until every worker has finished.
+    void Wait()
+    {
+        for (std::thread& thread : this->workers)
+        {
+            thread.join();
+        }
+        this->workers.clear();
+    }
 
-                SDL_WriteSurfacePixelFloat(
-                    this->surface,
-                    w, h,
-                    r, g, b, 1.0f
-                );
-            }
+    // Stops the workers after the tiles they are on and waits for them.
+    void Cancel()
+    {
+        this->RequestStop();
+        this->Wait();
+    }
 
-            if (this->texture == nullptr)
-            {
-                this->texture = SDL_CreateTextureFromSurface(
-                    renderer, this->surface
-                );
-            }
-            else
+    // Uploads the tiles updated since the last call into `texture`. Meant to be
+    // called once per UI frame: it never waits for the workers, so the render
+    // speed does not depend on how often (or with which vsync) the UI presents.
+    // Returns true if the texture changed.
+    bool UploadTiles(SDL_Renderer* renderer)
+    {
+        if (this->texture == nullptr)
+        {
+            this->texture = SDL_CreateTexture(
+                renderer,
+                SDL_PIXELFORMAT_RGB24,
+                SDL_TEXTUREACCESS_STREAMING,
+                this->image.width,
+                this->image.height
+            );
+        }
+
+        bool uploaded_any = false;
+
+        for (size_t i = 0; i < this->tiles.size(); ++i)
+        {
+            const int tile_version = this->tile_versions[i].load(std::memory_order_acquire);
+            if (tile_version == this->tile_uploaded_versions[i])
             {
-                SDL_UpdateTexture(this->texture, NULL, this->surface->pixels, this->surface->pitch);
+                continue;
             }
 
-            SDL_RenderClear(renderer);
-            SDL_RenderTexture(renderer, texture, NULL, NULL);
-            SDL_RenderPresent(renderer);
+            // The image is tightly packed RGB, so a tile is a sub-rectangle of it
+            // with the image's own pitch. In progressive mode a worker may already
+            // be writing the next pass into the tile, which at worst shows a mix of
+            // two passes for one frame.
+            const Tile& tile = this->tiles[i];
+            const SDL_Rect rect = { tile.x_begin, tile.y_begin, tile.x_end - tile.x_begin, tile.y_end - tile.y_begin };
+
+            SDL_UpdateTexture(
+                this->texture,
+                &rect,
+                this->image.PixelData(tile.x_begin, tile.y_begin),
+                this->image.BytesPerScanline()
+            );
+
+            this->tile_uploaded_versions[i] = tile_version;
+            uploaded_any = true;
         }
+
+        return uploaded_any;
     }
 
 private:
+    struct Tile
+    {
+        int x_begin, y_begin;
+        int x_end, y_end;
+    };
+
     Image image = Image(this->image_width, this->image_height);
 
-    double aspect_ratio = 1.0;  // Ratio of image width over height
+    // Called by the last worker to reach the end of a pass, before any of them
+    // continues.
+    struct PassCompletion
+    {
+        Camera* camera;
+
+        void operator()() noexcept
+        {
+            this->camera->FinishPass();
+        }
+    };
+
+    // Per pixel: sum of all samples, sum of their squared luminances, and how
+    // many there are.
+    std::vector<Color>  accumulation;
+    std::vector<double> luminance_squares;
+    std::vector<int>    pixel_samples;
+    std::vector<uint8_t> pixel_converged;  // Set by the pixel's own tile, see `UpdateConverged()`
+
+    // Per pixel: whether its estimate was still noisy after a pass, one set for
+    // even and one for odd passes (see `UpdateConverged()`).
+    std::vector<uint8_t> pixel_noisy[2];
+
+    Hit_List lights;  // Emissive primitives of the world being rendered
+
+    std::vector<Tile> tiles;
+    std::atomic<size_t> next_tile = 0;
+    std::unique_ptr<std::atomic<int>[]> tile_versions;  // Bumped whenever a tile's pixels change
+    std::vector<int> tile_uploaded_versions;            // Only touched by the UI thread
+
+    std::vector<std::thread> workers;
+    std::unique_ptr<std::barrier<PassCompletion>> pass_barrier;
+    std::atomic<int>  workers_running = 0;
+    std::atomic<bool> stop_requested  = false;
+
+    static constexpr int adaptive_pass_samples = 4;  // Samples per pass after the first, in adaptive mode
+
+    int  pass = 0;             // Only changed inside `FinishPass()`
+    bool finished = false;     // Only changed inside `FinishPass()`
+    std::atomic<uint64_t> samples_taken = 0;
+    std::atomic<uint64_t> unfinished_pixels = 0;  // Pixels below their cap after this pass
+    uint64_t pass_start_samples = 0;              // Only changed inside `FinishPass()`
+    std::chrono::steady_clock::time_point render_start;
+
+    real aspect_ratio = 1.0;  // Ratio of image width over height
 
     Point3 pixel00_location;  // Location of pixel (0, 0)
     Vec3   pixel_delta_u;     // Offset to pixel to the right
     Vec3   pixel_delta_v;     // Offset to pixel to the bottom
 
-    double pixel_samples_scale = 1;  // Color scale factor for a sum of pixel samples
-
     Vec3 u, v, w;                        // Camera frame basis vectors (right, up, opposite view direction)
 
     Vec3 defocus_disk_u, defocus_disk_v; // Defocus disk horizontal, vertical radius
@@ -131,16 +280,21 @@ private:
     void Initialize()
     {
         this->image = Image(this->image_width, this->image_height);
+        const size_t pixel_count = size_t(this->image_width) * this->image_height;
+        this->accumulation.assign(pixel_count, Color(0, 0, 0));
+        this->luminance_squares.assign(pixel_count, 0);
+        this->pixel_samples.assign(pixel_count, 0);
+        this->pixel_converged.assign(pixel_count, false);
+        this->pixel_noisy[0].assign(pixel_count, true);
+        this->pixel_noisy[1].assign(pixel_count, true);
 
-        this->pixel_samples_scale = 1.0 / samples_per_pixel;
-
-        this->aspect_ratio = (double)this->image_width / (double)this->image_height;
+        this->aspect_ratio = (real)this->image_width / (real)this->image_height;
 
         // Viewport dimensions.
-        const double theta = DegreesToRadians(this->fov_vertical);
-        const double h = std::tan(theta / 2);
-        const double viewport_height = 2 * h * this->focus_distance;
-        const double viewport_width = viewport_height * this->aspect_ratio;
+        const real theta = DegreesToRadians(this->fov_vertical);
+        const real h = std::tan(theta / 2);
+        const real viewport_height = 2 * h * this->focus_distance;
+        const real viewport_width = viewport_height * this->aspect_ratio;
 
         // Calculate u, v, w.
         this->w = -this->direction;
@@ -152,18 +306,659 @@ private:
         const Vec3 viewport_v = -this->v * viewport_height;
 
         // Calculate the horizontal and vertical delta vectors from pixel to pixel.
-        this->pixel_delta_u = viewport_u / (double)this->image_width;
-        this->pixel_delta_v = viewport_v / (double)this->image_height;
+        this->pixel_delta_u = viewport_u / (real)this->image_width;
+        this->pixel_delta_v = viewport_v / (real)this->image_height;
 
         // Calculate the location of pixel (0, 0).
         const Vec3 viewport_upper_left = this->origin - this->w * this->focus_distance - viewport_u / 2 - viewport_v / 2;
         this->pixel00_location = viewport_upper_left + 0.5 * (this->pixel_delta_u + this->pixel_delta_v);
 
-        const double defocus_radius = this->focus_distance * std::tan(DegreesToRadians(this->defocus_angle / 2));
+        const real defocus_radius = this->focus_distance * std::tan(DegreesToRadians(this->defocus_angle / 2));
         this->defocus_disk_u = u * defocus_radius;
         this->defocus_disk_v = v * defocus_radius;
     }
 
+    // Prepares the camera and the tile list, then starts the workers. The workers
+    // are joined by `Wait()`.
+    void StartWorkers(const Hittable& world, const Hit_List& lights)
+    {
+        const int previous_width  = this->image.width;
+        const int previous_height = this->image.height;
+
+        this->Initialize();
+
+        this->lights = this->light_sampling ? lights : Hit_List();
+
+        // A texture of the old size cannot take the new tiles.
+        if (this->texture != nullptr && (this->image.width != previous_width || this->image.height != previous_height))
+        {
+            SDL_DestroyTexture(this->texture);
+            this->texture = nullptr;
+        }
+
+        // Split the image into tiles. Workers pull tiles from a shared counter, so
+        // faster workers simply take more tiles and no thread sits idle at the end.
+        this->tiles.clear();
+        for (int y = 0; y < this->image_height; y += this->tile_size)
+        {
+            for (int x = 0; x < this->image_width; x += this->tile_size)
+            {
+                this->tiles.push_back(Tile{
+                    x, y,
+                    std::min(x + this->tile_size, this->image_width),
+                    std::min(y + this->tile_size, this->image_height)
+                });
+            }
+        }
+
+        this->next_tile = 0;
+        this->tile_versions.reset(new std::atomic<int>[this->tiles.size()]);
+        for (size_t i = 0; i < this->tiles.size(); ++i)
+        {
+            this->tile_versions[i] = 0;
+        }
+        this->tile_uploaded_versions.assign(this->tiles.size(), 0);
+
+        this->pass = 0;
+        this->finished = false;
+        this->samples_taken = 0;
+        this->unfinished_pixels = 0;
+        this->pass_start_samples = 0;
+        this->stop_requested = false;
+        this->render_start = std::chrono::steady_clock::now();
+
+        // Every pass goes over all tiles, and the barrier keeps two passes from
+        // touching the same tile at once.
+        const auto worker = [this, &world]()
+        {
+            while (true)
+            {
+                for (size_t i = this->next_tile++; i < this->tiles.size(); i = this->next_tile++)
+                {
+                    if (this->ShouldStop())
+                    {
+                        break;
+                    }
+
+                    this->RenderTile(world, this->tiles[i], i);
+                }
+
+                this->pass_barrier->arrive_and_wait();
+
+                if (this->finished)
+                {
+                    break;
+                }
+            }
+
+            this->workers_running.fetch_sub(1, std::memory_order_release);
+        };
+
+        int thread_count = this->thread_count;
+        if (thread_count <= 0)
+        {
+            thread_count = std::max(1, (int)std::thread::hardware_concurrency());
+        }
+
+        this->pass_barrier = std::make_unique<std::barrier<PassCompletion>>(thread_count, PassCompletion{ this });
+
+        this->workers_running = thread_count;
+        for (int i = 0; i < thread_count; ++i)
+        {
+            this->workers.emplace_back(worker);
+        }
+    }
+
+    bool ShouldStop() const
+    {
+        if (this->stop_requested)
+        {
+            return true;
+        }
+
+        return this->progressive && this->time_budget > 0 &&
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - this->render_start).count() >= this->time_budget;
+    }
+
+    // Only reduces what the workers counted, everything per pixel is done in
+    // the tiles.
+    void FinishPass()
+    {
+        ++this->pass;
+        this->next_tile = 0;
+
+        // Adaptive sampling only finds the converged pixels at the start of the
+        // next pass, so a pass that takes no samples at all ends the render too.
+        const uint64_t samples = this->samples_taken;
+        const bool took_samples = samples > this->pass_start_samples;
+        this->pass_start_samples = samples;
+
+        this->finished = this->unfinished_pixels.exchange(0) == 0 || took_samples == false || this->ShouldStop();
+    }
+
+    // A pixel counts as converged when neither it nor any of its 8 neighbours was
+    // above the noise threshold after the previous pass. The estimate of a single
+    // pixel is itself noisy, and without the neighbours too many pixels stop early
+    // after a few lucky samples.
+    //
+    // Runs at the start of the tile's pass. The flags of the previous pass are
+    // final by then, and this pass writes the other set, so reading those of the
+    // neighbouring tiles is safe.
+    void UpdateConverged(const Tile& tile)
+    {
+        const int width  = this->image_width;
+        const int height = this->image_height;
+
+        const std::vector<uint8_t>& noisy = this->pixel_noisy[(this->pass + 1) & 1];
+
+        for (int y = tile.y_begin; y < tile.y_end; ++y)
+        {
+            for (int x = tile.x_begin; x < tile.x_end; ++x)
+            {
+                bool converged = true;
+                for (int ny = std::max(0, y - 1); ny <= std::min(height - 1, y + 1) && converged; ++ny)
+                {
+                    for (int nx = std::max(0, x - 1); nx <= std::min(width - 1, x + 1); ++nx)
+                    {
+                        if (noisy[size_t(ny) * width + nx])
+                        {
+                            converged = false;
+                            break;
+                        }
+                    }
+                }
+
+                this->pixel_converged[size_t(y) * width + x] = converged;
+            }
+        }
+    }
+
+    // Runs at the end of the tile's pass: records which of its pixels are still
+    // noisy, and counts those that have not reached the sample cap.
+    void FinishTile(const Tile& tile)
+    {
+        const bool adaptive = this->adaptive_threshold > 0;
+        const int cap = this->samples_per_pixel;
+
+        std::vector<uint8_t>& noisy = this->pixel_noisy[this->pass & 1];
+        uint64_t unfinished = 0;
+
+        for (int y = tile.y_begin; y < tile.y_end; ++y)
+        {
+            for (int x = tile.x_begin; x < tile.x_end; ++x)
+            {
+                const size_t pixel = size_t(y) * this->image_width + x;
+
+                if (adaptive)
+                {
+                    noisy[pixel] =
+                        this->pixel_samples[pixel] < this->adaptive_min_samples ||
+                        this->PixelError(pixel) >= this->adaptive_threshold;
+                }
+
+                if (cap == 0 || this->pixel_samples[pixel] < cap)
+                {
+                    ++unfinished;
+                }
+            }
+        }
+
+        if (unfinished > 0)
+        {
+            this->unfinished_pixels.fetch_add(unfinished, std::memory_order_relaxed);
+        }
+    }
+
+    // How many samples pixel `pixel` gets in the current pass, 0 once it is done.
+    int PassSamples(const size_t pixel) const
+    {
+        const int taken = this->pixel_samples[pixel];
+        const int cap   = this->samples_per_pixel;
+        const bool adaptive = this->adaptive_threshold > 0;
+
+        if ((cap > 0 && taken >= cap) || this->pixel_converged[pixel])
+        {
+            return 0;
+        }
+
+        int samples = 1;
+        if (this->progressive == false)
+        {
+            if (adaptive)
+            {
+                samples = taken == 0 ? this->adaptive_min_samples : adaptive_pass_samples;
+            }
+            else
+            {
+                samples = cap;
+            }
+        }
+
+        return cap > 0 ? std::min(samples, cap - taken) : samples;
+    }
+
+    // Standard error of the pixel's mean luminance, carried over to the sqrt
+    // gamma curve that `Image::WriteColor()` applies: d(sqrt(L)) = dL / (2 sqrt(L)).
+    double PixelError(const size_t pixel) const
+    {
+        const int n = this->pixel_samples[pixel];
+        if (n < 2)
+        {
+            return infinity;
+        }
+
+        const double mean = Luminance(this->accumulation[pixel]) / n;
+        const double variance = std::max(0.0, (this->luminance_squares[pixel] / n - mean * mean) * n / (n - 1));
+        const double standard_error = std::sqrt(variance / n);
+
+        return standard_error / (2 * std::sqrt(std::max(mean, 1e-4)));
+    }
+
+    static double Luminance(const Color& color)
+    {
+        return 0.2126 * color.x() + 0.7152 * color.y() + 0.0722 * color.z();
+    }
+
+    // Adds one sample to the sums a pixel collects over a pass.
+    static void AddSample(const Color& color, Color& color_sum, double& luminance_square_sum)
+    {
+        const double luminance = Luminance(color);
+        color_sum += color;
+        luminance_square_sum += luminance * luminance;
+    }
+
+    // Adds the `samples` a pass took of pixel (x, y), with the sums of their
+    // colors and squared luminances, and writes its new average into `image`.
+    // Each worker writes only the pixels of its own tile.
+    void AddPixelSamples(const int x, const int y, const int samples, const Color& color_sum, const double luminance_square_sum)
+    {
+        const uint64_t pixel = uint64_t(y) * this->image_width + x;
+
+        this->accumulation[pixel] += color_sum;
+        this->luminance_squares[pixel] += luminance_square_sum;
+        this->pixel_samples[pixel] += samples;
+        this->image.WriteColor(x, y, this->accumulation[pixel] / this->pixel_samples[pixel]);
+    }
+
+    // Adds this pass's samples to every pixel of the tile that still wants them,
+    // and writes the new averages into `image`.
+    void RenderTile(const Hittable& world, const Tile& tile, const size_t tile_index)
+    {
+        if (this->adaptive_threshold > 0)
+        {
+            this->UpdateConverged(tile);
+        }
+
+        uint64_t tile_samples = 0;
+
+        if (this->wavefront)
+        {
+            tile_samples = this->RenderTileWavefront(world, tile);
+        }
+        else
+        {
+            const int run_length = this->ray_packets ? RayPacket::size : 1;
+
+            for (int h = tile.y_begin; h < tile.y_end; ++h)
+            {
+                for (int w = tile.x_begin; w < tile.x_end; w += run_length)
+                {
+                    tile_samples += this->RenderPixels(world, w, std::min(w + run_length, tile.x_end), h);
+                }
+            }
+        }
+
+        this->FinishTile(tile);
+
+        if (tile_samples > 0)
+        {
+            this->samples_taken += tile_samples;
+            this->tile_versions[tile_index].fetch_add(1, std::memory_order_release);
+        }
+    }
+
+    // Adds this pass's samples to the pixels [x_begin, x_end) of row y, at most
+    // `RayPacket::size` of them. The camera rays of every round of samples go
+    // through the scene as one packet. Returns how many samples were taken.
+    uint64_t RenderPixels(const Hittable& world, const int x_begin, const int x_end, const int y)
+    {
+        const int count = x_end - x_begin;
+
+        // Every pixel has its own random stream per pass, which keeps the image
+        // identical regardless of the thread count, tile size and packets. The
+        // pixels of a packet take turns on this thread's generator.
+        Pcg32 generators[RayPacket::size];
+        int samples[RayPacket::size];
+        int max_samples = 0;
+
+        Color pixel_colors[RayPacket::size];
+        double pixel_luminance_squares[RayPacket::size] = {};
+
+        for (int i = 0; i < count; ++i)
+        {
+            const uint64_t pixel = uint64_t(y) * this->image_width + x_begin + i;
+
+            samples[i] = this->PassSamples(pixel);
+            max_samples = std::max(max_samples, samples[i]);
+
+            SeedRandom(pixel, uint64_t(this->pass));
+            generators[i] = RandomGenerator();
+        }
+
+        for (int sample = 0; sample < max_samples; ++sample)
+        {
+            RayPacket packet;
+            uint32_t active = 0;
+
+            for (int i = 0; i < count; ++i)
+            {
+                if (sample < samples[i])
+                {
+                    RandomGenerator() = generators[i];
+                    packet.SetLane(i, this->GetRay(x_begin + i, y), Interval(0, infinity));
+                    generators[i] = RandomGenerator();
+
+                    active |= 1u << i;
+                }
+            }
+
+            HitRecord hit_records[RayPacket::size];
+            uint32_t hit_lanes = 0;
+
+            if (count > 1)
+            {
+                packet.generators = generators;
+                hit_lanes = world.HitPacket(packet, active, hit_records);
+            }
+            else
+            {
+                // A lone pixel's stream is still the thread's generator.
+                hit_lanes = world.Hit(packet.rays[0], packet.LaneInterval(0), hit_records[0]) ? 1 : 0;
+                generators[0] = RandomGenerator();
+            }
+
+            RayPacket::ForEachLane(active, [&](const int i)
+            {
+                RandomGenerator() = generators[i];
+                const Color color = RayColor(packet.rays[i], world, (hit_lanes >> i) & 1, hit_records[i]);
+                generators[i] = RandomGenerator();
+
+                AddSample(color, pixel_colors[i], pixel_luminance_squares[i]);
+            });
+        }
+
+        uint64_t samples_taken = 0;
+
+        for (int i = 0; i < count; ++i)
+        {
+            if (samples[i] == 0)
+            {
+                continue;
+            }
+
+            this->AddPixelSamples(x_begin + i, y, samples[i], pixel_colors[i], pixel_luminance_squares[i]);
+            samples_taken += samples[i];
+        }
+
+        return samples_taken;
+    }
+
+    // State of the paths `RenderTileWavefront()` advances together, one per pixel
+    // of the tile, every field in its own array.
+    struct PathStates
+    {
+        std::vector<Pcg32>     generators;  // Random stream of the pixel
+        std::vector<Ray>       rays;
+        std::vector<HitRecord> hit_records;
+        std::vector<Color>     throughputs;
+        std::vector<Color>     radiances;
+        std::vector<real>      scatter_pdfs;
+        std::vector<Color>     scatter_weights;
+        std::vector<Vec3>      scatter_directions;
+
+        // Light sample waiting for its shadow ray.
+        std::vector<Ray>   shadow_rays;
+        std::vector<real>  shadow_t_maxes;
+        std::vector<Color> shadow_contributions;
+
+        // Per pixel: samples of this pass, and the sums of their colors and
+        // squared luminances.
+        std::vector<int>    samples;
+        std::vector<Color>  pixel_colors;
+        std::vector<double> pixel_luminance_squares;
+
+        void Resize(const size_t count)
+        {
+            this->generators.resize(count);
+            this->rays.resize(count);
+            this->hit_records.resize(count);
+            this->throughputs.resize(count);
+            this->radiances.resize(count);
+            this->scatter_pdfs.resize(count);
+            this->scatter_weights.resize(count);
+            this->scatter_directions.resize(count);
+            this->shadow_rays.resize(count);
+            this->shadow_t_maxes.resize(count);
+            this->shadow_contributions.resize(count);
+            this->samples.resize(count);
+            this->pixel_colors.assign(count, Color(0, 0, 0));
+            this->pixel_luminance_squares.assign(count, 0);
+        }
+    };
+
+    // `RenderTile()` that runs the paths of every pixel of the tile as one batch
+    // instead of one after the other. Each bounce goes through the whole batch in
+    // stages (intersect, add emission, shade grouped by material, trace shadow
+    // rays, continue), and the paths that end drop out of it between stages.
+    // Every stage runs the same code over all paths, which keeps it in the
+    // caches. Each path still draws from its pixel's random stream in the same
+    // order as `RayColor()`, so the image comes out the same.
+    uint64_t RenderTileWavefront(const Hittable& world, const Tile& tile)
+    {
+        const int tile_width = tile.x_end - tile.x_begin;
+        const size_t pixel_count = size_t(tile_width) * (tile.y_end - tile.y_begin);
+
+        // Buffers are kept per worker thread, so tiles do not allocate.
+        thread_local PathStates paths;
+        thread_local std::vector<uint32_t> active, shadowed;
+        paths.Resize(pixel_count);
+
+        std::vector<int>& samples = paths.samples;
+        std::vector<Color>& pixel_colors = paths.pixel_colors;
+        std::vector<double>& pixel_luminance_squares = paths.pixel_luminance_squares;
+        int max_samples = 0;
+
+        const auto image_pixel = [&](const uint32_t i)
+        {
+            return uint64_t(tile.y_begin + int(i) / tile_width) * this->image_width + tile.x_begin + int(i) % tile_width;
+        };
+
+        for (uint32_t i = 0; i < pixel_count; ++i)
+        {
+            const uint64_t pixel = image_pixel(i);
+
+            samples[i] = this->PassSamples(pixel);
+            max_samples = std::max(max_samples, samples[i]);
+
+            SeedRandom(pixel, uint64_t(this->pass));
+            paths.generators[i] = RandomGenerator();
+        }
+
+        // Path `i` draws from its own stream while this is alive.
+        struct UseStream
+        {
+            Pcg32& generator;
+
+            UseStream(Pcg32& generator) : generator(generator) { std::swap(RandomGenerator(), this->generator); }
+            ~UseStream() { std::swap(RandomGenerator(), this->generator); }
+        };
+
+        const auto finish = [&](const uint32_t i)
+        {
+            AddSample(paths.radiances[i], pixel_colors[i], pixel_luminance_squares[i]);
+        };
+
+        const bool sample_lights = this->lights.objects.empty() == false;
+
+        for (int sample = 0; sample < max_samples; ++sample)
+        {
+            // Camera rays.
+            active.clear();
+            for (uint32_t i = 0; i < pixel_count; ++i)
+            {
+                if (sample >= samples[i])
+                {
+                    continue;
+                }
+
+                const UseStream stream(paths.generators[i]);
+                paths.rays[i] = this->GetRay(tile.x_begin + int(i) % tile_width, tile.y_begin + int(i) / tile_width);
+                paths.throughputs[i] = Color(1, 1, 1);
+                paths.radiances[i] = Color(0, 0, 0);
+                paths.scatter_pdfs[i] = 0;
+
+                active.push_back(i);
+            }
+
+            for (int depth = 0; depth < this->max_depth && active.empty() == false; ++depth)
+            {
+                // Intersect. Camera rays of neighbouring pixels are coherent and go
+                // as packets, like in `RenderPixels()`. Paths that leave the scene
+                // pick up the background and end.
+                const size_t group_size = depth == 0 && this->ray_packets ? RayPacket::size : 1;
+
+                size_t kept = 0;
+                for (size_t first = 0; first < active.size(); first += group_size)
+                {
+                    const int count = int(std::min(group_size, active.size() - first));
+
+                    RayPacket packet;
+                    Pcg32 generators[RayPacket::size];
+                    HitRecord hit_records[RayPacket::size];
+                    uint32_t path_indices[RayPacket::size];
+
+                    for (int lane = 0; lane < count; ++lane)
+                    {
+                        const uint32_t i = active[first + lane];
+                        path_indices[lane] = i;
+                        packet.SetLane(lane, paths.rays[i], Interval(0, infinity));
+                        generators[lane] = paths.generators[i];
+                    }
+
+                    packet.generators = generators;
+                    const uint32_t hit_lanes = world.HitPacket(packet, (1u << count) - 1, hit_records);
+
+                    for (int lane = 0; lane < count; ++lane)
+                    {
+                        const uint32_t i = path_indices[lane];
+                        paths.generators[i] = generators[lane];
+
+                        if (((hit_lanes >> lane) & 1) == 0)
+                        {
+                            paths.radiances[i] += paths.throughputs[i] * this->background;
+                            finish(i);
+                            continue;
+                        }
+
+                        paths.hit_records[i] = hit_records[lane];
+                        active[kept++] = i;
+                    }
+                }
+                active.resize(kept);
+
+                // Emission, and grouping by material so each one is shaded in a run.
+                for (const uint32_t i : active)
+                {
+                    this->AddEmission(paths.rays[i], paths.hit_records[i], paths.scatter_pdfs[i], paths.throughputs[i], paths.radiances[i]);
+                }
+
+                std::sort(active.begin(), active.end(), [&](const uint32_t a, const uint32_t b)
+                {
+                    return std::less<const Material*>()(paths.hit_records[a].material, paths.hit_records[b].material);
+                });
+
+                // Shade: sample the next direction and prepare the light sample.
+                kept = 0;
+                shadowed.clear();
+                for (const uint32_t i : active)
+                {
+                    const UseStream stream(paths.generators[i]);
+                    const HitRecord& hit_record = paths.hit_records[i];
+
+                    ScatterRecord scatter;
+                    if (hit_record.material->Sample(paths.rays[i], hit_record, scatter) == false)
+                    {
+                        finish(i);
+                        continue;
+                    }
+
+                    paths.scatter_pdfs[i] = sample_lights ? scatter.pdf : 0;
+                    paths.scatter_weights[i] = scatter.weight;
+                    paths.scatter_directions[i] = scatter.direction;
+
+                    if (paths.scatter_pdfs[i] > 0 &&
+                        this->PrepareLightSample(paths.rays[i], hit_record, paths.shadow_rays[i], paths.shadow_t_maxes[i], paths.shadow_contributions[i]))
+                    {
+                        shadowed.push_back(i);
+                    }
+
+                    active[kept++] = i;
+                }
+                active.resize(kept);
+
+                // Shadow rays.
+                for (const uint32_t i : shadowed)
+                {
+                    const UseStream stream(paths.generators[i]);
+
+                    if (world.Occluded(paths.shadow_rays[i], Interval(0, paths.shadow_t_maxes[i])) == false)
+                    {
+                        paths.radiances[i] += paths.throughputs[i] * paths.shadow_contributions[i];
+                    }
+                }
+
+                // Continue the surviving paths.
+                kept = 0;
+                for (const uint32_t i : active)
+                {
+                    const UseStream stream(paths.generators[i]);
+
+                    paths.throughputs[i] = paths.throughputs[i] * paths.scatter_weights[i];
+                    if (this->SurvivesRoulette(depth, paths.throughputs[i]) == false)
+                    {
+                        finish(i);
+                        continue;
+                    }
+
+                    paths.rays[i] = paths.hit_records[i].SpawnRay(paths.scatter_directions[i], paths.rays[i].Time());
+                    active[kept++] = i;
+                }
+                active.resize(kept);
+            }
+
+            // Paths still going after the last bounce.
+            for (const uint32_t i : active)
+            {
+                finish(i);
+            }
+        }
+
+        uint64_t tile_samples = 0;
+
+        for (uint32_t i = 0; i < pixel_count; ++i)
+        {
+            if (samples[i] == 0)
+            {
+                continue;
+            }
+
+            this->AddPixelSamples(tile.x_begin + int(i) % tile_width, tile.y_begin + int(i) / tile_width, samples[i], pixel_colors[i], pixel_luminance_squares[i]);
+            tile_samples += samples[i];
+        }
+
+        return tile_samples;
+    }
+
     Ray GetRay(const int x, const int y) const
     {
         // Construct a camera ray origintating from the defocused disk and directed
@@ -177,7 +972,7 @@ private:
 
         const Vec3 ray_origin = (defocus_angle <= 0) ? this->origin : DefocusDiskSample();
         const Vec3 ray_direction = pixel_sample - ray_origin;
-        const double ray_time = RandomDouble();
+        const real ray_time = RandomReal();
 
         return Ray(ray_origin, ray_direction, ray_time);
     }
@@ -185,7 +980,7 @@ private:
     Vec3 SampleSquare() const
     {
         // Returns the vector to a random point in the [-.5,-5]-[+.5,+.5] unit square.
-        return Vec3(RandomDouble() - 0.5, RandomDouble() - 0.5, 0);
+        return Vec3(RandomReal() - real(0.5), RandomReal() - real(0.5), 0);
     }
 
     Point3 DefocusDiskSample() const
@@ -194,37 +989,165 @@ private:
         return this->origin + (p.x() * this->defocus_disk_u) + (p.y() * this->defocus_disk_v);
     }
 
-    Color RayColor(const Ray& ray, const int depth, const Hittable& world) const
+    // The hit of the camera ray is found by the caller, which may trace it in a
+    // packet with others.
+    Color RayColor(const Ray& camera_ray, const Hittable& world, const bool camera_hit_found, const HitRecord& camera_hit) const
     {
-        if (depth < 1)
+        // Follows one path from the camera. `throughput` is the product of all
+        // attenuations so far, i.e. how much of the light found further along the
+        // path still reaches the camera.
+        Color radiance(0, 0, 0);
+        Color throughput(1, 1, 1);
+        Ray ray = camera_ray;
+
+        // At a diffuse hit light arrives two ways: through the shadow ray towards
+        // a sampled light, and through the scattered ray if it happens to run
+        // into an emitter. Both are kept and weighted by how likely each strategy
+        // was to find that light (multiple importance sampling), so neither is
+        // counted twice. `scatter_pdf` is 0 after a specular bounce, which light
+        // sampling cannot reproduce, and emission found then counts fully.
+        const bool sample_lights = this->lights.objects.empty() == false;
+        real scatter_pdf = 0;
+
+        for (int depth = 0; depth < this->max_depth; ++depth)
         {
-            return Color(0, 0, 0);
+            HitRecord hit_record;
+            bool hit_anything;
+
+            if (depth == 0)
+            {
+                hit_record = camera_hit;
+                hit_anything = camera_hit_found;
+            }
+            else
+            {
+                hit_anything = world.Hit(ray, Interval(0, infinity), hit_record);
+            }
+
+            if (hit_anything == false)
+            {
+                radiance += throughput * this->background;
+                break;
+            }
+
+            this->AddEmission(ray, hit_record, scatter_pdf, throughput, radiance);
+
+            ScatterRecord scatter;
+            if (hit_record.material->Sample(ray, hit_record, scatter) == false)
+            {
+                break;
+            }
+
+            scatter_pdf = sample_lights ? scatter.pdf : 0;
+
+            if (scatter_pdf > 0)
+            {
+                radiance += throughput * this->SampleLight(world, ray, hit_record);
+            }
+
+            throughput = throughput * scatter.weight;
+
+            if (this->SurvivesRoulette(depth, throughput) == false)
+            {
+                break;
+            }
+
+            ray = hit_record.SpawnRay(scatter.direction, ray.Time());
         }
 
-        HitRecord hit_record;
+        return radiance;
+    }
 
-        if (world.Hit(ray, Interval(0.001, infinity), hit_record) == false)
+    // Adds the light emitted at `hit_record`, weighted against light sampling
+    // having found it too (see `RayColor()`). Only the light `ray` hits counts
+    // towards that, light sampling can't reach the ones behind it.
+    void AddEmission(const Ray& ray, const HitRecord& hit_record, const real scatter_pdf, const Color& throughput, Color& radiance) const
+    {
+        const Color emitted = hit_record.material->Emit(hit_record.u, hit_record.v, hit_record.point);
+        if (emitted.NearZero())
         {
-            return this->background;
+            return;
         }
-        else
+
+        real weight = 1;
+        if (scatter_pdf > 0)
         {
-            Ray scattered;
-            Color attenuation;
-            const Color color_emitted = hit_record.material->Emit(hit_record.u, hit_record.v, hit_record.point);
+            const real light_pdf = this->lights.PdfValue(ray, Interval(0, hit_record.t * (1 + 2 * spawn_epsilon)));
+            weight = PowerHeuristic(scatter_pdf, light_pdf);
+        }
 
-            if (hit_record.material->Scatter(ray, hit_record, attenuation, scattered) == false)
-            {
-                return color_emitted;
-            }
-            
-            const Color color_scattered = attenuation * this->RayColor(scattered, depth - 1, world);
+        radiance += throughput * emitted * weight;
+    }
 
-            return color_emitted + color_scattered;
+    // Russian roulette: ends dim paths at random and boosts the survivors by the
+    // inverse of their survival chance, which keeps the estimate unbiased.
+    bool SurvivesRoulette(const int depth, Color& throughput) const
+    {
+        if (depth + 1 < this->russian_roulette_depth)
+        {
+            return true;
         }
 
-        // Background. 
-        const double a = 0.5 * (UnitVector(ray.Direction()).y() + 1.0);
-        return (1 - a) * Color(1, 1, 1) + a * Color(0.5, 0.7, 1.0);
+        const real survival = std::min(real(0.95), std::max({ throughput.x(), throughput.y(), throughput.z() }));
+        if (RandomReal() >= survival)
+        {
+            return false;
+        }
+
+        throughput /= survival;
+        return true;
+    }
+
+    // Light scattered along `ray_in` at `hit_record` that comes from a randomly
+    // chosen point on a light, with its MIS weight applied.
+    Color SampleLight(const Hittable& world, const Ray& ray_in, const HitRecord& hit_record) const
+    {
+        Ray shadow_ray;
+        real shadow_t_max;
+        Color contribution;
+
+        if (this->PrepareLightSample(ray_in, hit_record, shadow_ray, shadow_t_max, contribution) == false ||
+            world.Occluded(shadow_ray, Interval(0, shadow_t_max)))
+        {
+            return Color(0, 0, 0);
+        }
+
+        return contribution;
+    }
+
+    // `SampleLight()` up to the shadow ray: picks the point on a light and works
+    // out what it contributes if nothing blocks `shadow_ray` before
+    // `shadow_t_max`. Returns false if it contributes nothing anyway. The light
+    // sample comes with its emission and density, so the shadow ray is the only
+    // ray traced for it.
+    bool PrepareLightSample(const Ray& ray_in, const HitRecord& hit_record, Ray& shadow_ray, real& shadow_t_max, Color& contribution) const
+    {
+        const LightSample light = this->lights.Random(hit_record.point);
+        if (light.pdf <= 0)
+        {
+            return false;
+        }
+
+        // Aimed from where the ray actually starts, so it reaches the light at
+        // t = 1. It stops just short of that, the light itself isn't in the way.
+        const Point3 origin = hit_record.SpawnRay(light.point - hit_record.point, ray_in.Time()).Origin();
+        shadow_ray = Ray(origin, light.point - origin, ray_in.Time());
+        shadow_t_max = 1 - 2 * spawn_epsilon;
+
+        const real scatter_pdf = hit_record.material->Pdf(ray_in, hit_record, shadow_ray.Direction());
+        if (scatter_pdf <= 0)
+        {
+            return false;
+        }
+
+        const Color scattering = hit_record.material->Eval(ray_in, hit_record, shadow_ray.Direction());
+
+        contribution = scattering * light.emitted * (PowerHeuristic(light.pdf, scatter_pdf) / light.pdf);
+        return true;
+    }
+
+    static real PowerHeuristic(const real pdf, const real other_pdf)
+    {
+        return (pdf * pdf) / (pdf * pdf + other_pdf * other_pdf);
     }
 };
@@ -2,15 +2,19 @@
 
 #include "Hit_ConstantMedium.hpp"
 
+#include "Benchmark.hpp"
 #include "Camera.hpp"
 #include "Color.hpp"
 #include "Hittable.hpp"
 #include "Material.hpp"
+#include "Scene.hpp"
 #include "Texture.hpp"
 #include "Util.hpp"
 #include "Vec3.hpp"
 
+#include <algorithm>
 #include <chrono>
+#include <cstdlib>
 #include <iostream>
 #include <memory>
 #include <string>
@@ -20,7 +24,6 @@
 #include <backends/imgui_impl_sdlrenderer3.h>
 
 #include <SDL3/SDL.h>
-#include <SDL3_image/SDL_image.h>
 
 #include <tinyfiledialogs.h>
 
@@ -37,10 +40,276 @@ struct CameraSettings
     int height = 384;
     int samples = 2;
     int bounces = 2;
+    bool progressive = false;
+    float time_budget = 0.0f;
+    float noise_threshold = 0.0f;
+    bool light_sampling = true;
+    bool ray_packets = true;
+    bool wavefront = false;
+
+    bool operator==(const CameraSettings&) const = default;
 };
 
-int main()
+void ApplySettings(Camera& camera, const CameraSettings& settings)
 {
+    camera.image_width = settings.width;
+    camera.image_height = settings.height;
+    camera.samples_per_pixel = settings.samples;
+    camera.max_depth = settings.bounces;
+    camera.progressive = settings.progressive;
+    camera.time_budget = settings.time_budget;
+    camera.adaptive_threshold = settings.noise_threshold;
+    camera.light_sampling = settings.light_sampling;
+    camera.ray_packets = settings.ray_packets;
+    camera.wavefront = settings.wavefront;
+    camera.fov_vertical = settings.fov;
+    camera.origin = Point3(settings.position[0], settings.position[1], settings.position[2]);
+    camera.direction = UnitVector(Vec3(settings.direction[0], settings.direction[1], settings.direction[2]));
+    camera.direction_up = Vec3(0, 1, 0);
+    camera.defocus_angle = 0;
+    camera.background = Color(255.0 / 255.0, 242 / 255.0, 202.0 / 255.0);
+}
+
+bool ParseInt(const char* text, int& value)
+{
+    char* end = nullptr;
+    const long parsed = std::strtol(text, &end, 10);
+    if (end == text || *end != '\0')
+    {
+        return false;
+    }
+    value = (int)parsed;
+    return true;
+}
+
+bool ParseFloat(const char* text, float& value)
+{
+    char* end = nullptr;
+    const float parsed = std::strtof(text, &end);
+    if (end == text || *end != '\0')
+    {
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+void PrintUsage()
+{
+    std::cout <<
+        "Usage:\n"
+        "  HelloWorld                       Open the interactive window.\n"
+        "  HelloWorld --render <file.obj>   Render without a window and write a PNG.\n"
+        "  HelloWorld --bench-triangles     Run the triangle intersection benchmark.\n"
+        "  HelloWorld --bench-random        Run the random number generator benchmark.\n"
+        "  HelloWorld --bench-occlusion     Compare closest-hit and shadow ray queries.\n"
+        "  HelloWorld --bench-vec3          Run the vector math benchmark.\n"
+        "  HelloWorld --bench-packets       Compare single-ray and packet traversal.\n"
+        "\n"
+        "Options for --render:\n"
+        "  --output <file.png>      Output image (default: render.png)\n"
+        "  --width <pixels>         Image width\n"
+        "  --height <pixels>        Image height\n"
+        "  --samples <count>        Samples per pixel, the maximum with --noise, and\n"
+        "                           0 means no limit with --time-budget\n"
+        "  --bounces <count>        Maximum ray bounces\n"
+        "  --fov <degrees>          Vertical field of view\n"
+        "  --position <x> <y> <z>   Camera position\n"
+        "  --direction <x> <y> <z>  Camera viewing direction\n"
+        "  --threads <count>        Render threads, 0 means one per hardware thread\n"
+        "  --time-budget <seconds>  Render progressively until the time runs out or\n"
+        "                           --samples is reached\n"
+        "  --noise <threshold>      Stop sampling pixels whose noise is below this\n"
+        "                           (e.g. 0.01, in units of the 0..1 output range)\n"
+        "  --min-samples <count>    Samples per pixel before --noise is checked\n"
+        "  --no-light-sampling      Only find lights by bouncing into them\n"
+        "  --no-ray-packets         Trace every camera ray on its own\n"
+        "  --wavefront              Advance all paths of a tile together, stage by stage\n"
+        "  --no-scene-cache         Parse the OBJ file even if its .rtcache is up to date\n";
+}
+
+// Command-line render path. Never creates a window or a texture, so it runs on
+// machines without a display and can be scripted, profiled and benchmarked.
+int RenderHeadless(const int argc, char* argv[])
+{
+    CameraSettings settings;
+    std::string obj_path;
+    std::string output_path = "render.png";
+    int thread_count = 0;
+    int min_samples = 0;
+    bool scene_cache = true;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        const int values_left = argc - i - 1;
+
+        bool valid = true;
+
+        if (arg == "--render" && values_left >= 1)
+        {
+            obj_path = argv[++i];
+        }
+        else if (arg == "--output" && values_left >= 1)
+        {
+            output_path = argv[++i];
+        }
+        else if (arg == "--width" && values_left >= 1)
+        {
+            valid = ParseInt(argv[++i], settings.width) && settings.width > 0;
+        }
+        else if (arg == "--height" && values_left >= 1)
+        {
+            valid = ParseInt(argv[++i], settings.height) && settings.height > 0;
+        }
+        else if (arg == "--samples" && values_left >= 1)
+        {
+            valid = ParseInt(argv[++i], settings.samples) && settings.samples >= 0;
+        }
+        else if (arg == "--bounces" && values_left >= 1)
+        {
+            valid = ParseInt(argv[++i], settings.bounces) && settings.bounces > 0;
+        }
+        else if (arg == "--fov" && values_left >= 1)
+        {
+            valid = ParseFloat(argv[++i], settings.fov);
+        }
+        else if (arg == "--position" && values_left >= 3)
+        {
+            valid =
+                ParseFloat(argv[i + 1], settings.position[0]) &&
+                ParseFloat(argv[i + 2], settings.position[1]) &&
+                ParseFloat(argv[i + 3], settings.position[2]);
+            i += 3;
+        }
+        else if (arg == "--direction" && values_left >= 3)
+        {
+            valid =
+                ParseFloat(argv[i + 1], settings.direction[0]) &&
+                ParseFloat(argv[i + 2], settings.direction[1]) &&
+                ParseFloat(argv[i + 3], settings.direction[2]);
+            i += 3;
+        }
+        else if (arg == "--threads" && values_left >= 1)
+        {
+            valid = ParseInt(argv[++i], thread_count) && thread_count >= 0;
+        }
+        else if (arg == "--time-budget" && values_left >= 1)
+        {
+            valid = ParseFloat(argv[++i], settings.time_budget) && settings.time_budget > 0;
+            settings.progressive = true;
+        }
+        else if (arg == "--noise" && values_left >= 1)
+        {
+            valid = ParseFloat(argv[++i], settings.noise_threshold) && settings.noise_threshold >= 0;
+        }
+        else if (arg == "--min-samples" && values_left >= 1)
+        {
+            valid = ParseInt(argv[++i], min_samples) && min_samples > 1;
+        }
+        else if (arg == "--no-light-sampling")
+        {
+            settings.light_sampling = false;
+        }
+        else if (arg == "--no-ray-packets")
+        {
+            settings.ray_packets = false;
+        }
+        else if (arg == "--wavefront")
+        {
+            settings.wavefront = true;
+        }
+        else if (arg == "--no-scene-cache")
+        {
+            scene_cache = false;
+        }
+        else
+        {
+            valid = false;
+        }
+
+        if (valid == false)
+        {
+            std::cerr << "[ERROR]: Invalid argument `" << arg << "'\n";
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    // Only a progressive render has something else to stop it.
+    if (obj_path.empty() || (settings.samples == 0 && settings.progressive == false))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    Camera camera;
+    ApplySettings(camera, settings);
+    camera.thread_count = thread_count;
+    if (min_samples > 0)
+    {
+        camera.adaptive_min_samples = min_samples;
+    }
+
+    const auto load_start = std::chrono::high_resolution_clock::now();
+    Scene scene;
+    scene.Load(obj_path, scene_cache);
+    const auto load_end = std::chrono::high_resolution_clock::now();
+
+    std::cout << "Loaded `" << obj_path << "' in "
+        << std::chrono::duration<double, std::milli>(load_end - load_start).count() << " ms\n";
+
+    const auto render_start = std::chrono::high_resolution_clock::now();
+    camera.Render(scene.World(), scene.Lights());
+    const auto render_end = std::chrono::high_resolution_clock::now();
+
+    const double render_seconds = std::chrono::duration<double>(render_end - render_start).count();
+    const double samples = double(camera.SamplesTaken());
+
+    std::cout << "Rendered " << settings.width << "x" << settings.height << " at "
+        << camera.AverageSamplesPerPixel() << " spp in " << render_seconds << " s ("
+        << samples / render_seconds << " samples/s)\n";
+
+    if (camera.GetImage().WritePNG(output_path) == 0)
+    {
+        std::cerr << "[ERROR]: Could not write `" << output_path << "'\n";
+        return 1;
+    }
+
+    std::cout << "Wrote `" << output_path << "'\n";
+
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    const struct
+    {
+        const char* option;
+        void (*run)(std::ostream& out);
+    } benchmarks[] =
+    {
+        { "--bench-triangles", BenchmarkTriangleIntersection },
+        { "--bench-random", BenchmarkRandom },
+        { "--bench-occlusion", BenchmarkOcclusion },
+        { "--bench-vec3", BenchmarkVectorMath },
+        { "--bench-packets", BenchmarkPacketTraversal },
+    };
+
+    for (const auto& benchmark : benchmarks)
+    {
+        if (argc > 1 && std::string(argv[1]) == benchmark.option)
+        {
+            benchmark.run(std::cout);
+            return 0;
+        }
+    }
+
+    if (argc > 1)
+    {
+        return RenderHeadless(argc, argv);
+    }
+
     if (!SDL_Init(SDL_INIT_VIDEO))
     {
         printf("Error: SDL_Init(): %s\n", SDL_GetError());
@@ -78,13 +347,49 @@ int main()
 
     CameraSettings settings;
 
-    SDL_Texture* texture = nullptr;
+    // Declared before the camera, so the camera (and its workers) go first.
+    Scene scene;
     Camera camera;
 
-    char* obj_path = nullptr;
+    double load_milliseconds = 0;
+    bool scene_rendered = false;
+    CameraSettings rendered_settings;
 
+    bool rendering = false;
+    std::chrono::high_resolution_clock::time_point render_start;
     long long duration = 0;
 
+    // Stops the current render and shows the tiles it finished since the last
+    // frame, so a stopped render keeps what it computed.
+    const auto stop_render = [&]()
+    {
+        camera.Cancel();
+
+        if (camera.texture != nullptr)
+        {
+            camera.UploadTiles(renderer);
+        }
+    };
+
+    const auto start_render = [&]()
+    {
+        // The previous render still reads the world.
+        stop_render();
+
+        SDL_SetWindowSize(window, settings.width, settings.height);
+        SDL_SetWindowPosition(window, 32, 32);
+
+        ApplySettings(camera, settings);
+        rendered_settings = settings;
+
+        // Start timing
+        render_start = std::chrono::high_resolution_clock::now();
+        rendering = true;
+
+        // Returns right away, the frames below show the tiles as they finish.
+        camera.StartRender(scene.World(), scene.Lights());
+    };
+
     bool done = false;
     while (!done)
     {
@@ -110,7 +415,7 @@ int main()
             {
                 char const* lFilterPatterns[1] = { "*.obj" };
 
-                obj_path = tinyfd_openFileDialog(
+                const char* obj_path = tinyfd_openFileDialog(
                     "Select an .obj file",
                     "",
                     1,
@@ -118,6 +423,27 @@ int main()
                     NULL,
                     0
                 );
+
+                // The scene is loaded once here. Renders only read it, so changing
+                // the camera or the sampling settings costs no preprocessing.
+                if (obj_path)
+                {
+                    // The previous render still reads the old scene.
+                    stop_render();
+                    scene_rendered = false;
+
+                    const auto load_start = std::chrono::high_resolution_clock::now();
+                    scene.Load(std::string(obj_path));
+                    const auto load_end = std::chrono::high_resolution_clock::now();
+
+                    load_milliseconds = std::chrono::duration<double, std::milli>(load_end - load_start).count();
+                }
+            }
+
+            if (scene.IsLoaded())
+            {
+                ImGui::SameLine();
+                ImGui::Text("%s (loaded in %.0f ms)", scene.Path().c_str(), load_milliseconds);
             }
 
             ImGui::SliderFloat("FOV", &settings.fov, 1.0f, 180.0f, "%.1f deg");
@@ -129,48 +455,62 @@ int main()
             ImGui::SliderInt("Width", &settings.width, 1, 1000);
             ImGui::SliderInt("Height", &settings.height, 1, 1000);
 
-            ImGui::SliderInt("Samples", &settings.samples, 1, 128);
-            ImGui::SliderInt("Bounces", &settings.bounces, 1, 32);
+            ImGui::Checkbox("Progressive", &settings.progressive);
 
-            if (ImGui::Button("Render") && obj_path)
+            if (settings.progressive)
+            {
+                ImGui::SliderInt("Samples", &settings.samples, 0, 4096, "%d (0 = until stopped)");
+                ImGui::InputFloat("Time budget", &settings.time_budget, 1.0f, 10.0f, "%.1f s (0 = none)");
+                settings.time_budget = std::max(settings.time_budget, 0.0f);
+            }
+            else
             {
-                // Start timing
-                const auto start = std::chrono::high_resolution_clock::now();
+                // The slider does not clamp a value it is not dragging, and 0
+                // ("until stopped") left over from progressive mode would render
+                // nothing.
+                settings.samples = std::max(settings.samples, 1);
+                ImGui::SliderInt("Samples", &settings.samples, 1, 128);
+            }
 
-                if (texture != nullptr)
-                {
-                    SDL_free(texture);
-                }
+            ImGui::SliderFloat("Noise threshold", &settings.noise_threshold, 0.0f, 0.05f, "%.3f (0 = off)");
 
-                SDL_SetWindowSize(window, settings.width, settings.height);
-                SDL_SetWindowPosition(window, 32, 32);
+            ImGui::SliderInt("Bounces", &settings.bounces, 1, 32);
+            ImGui::Checkbox("Light sampling", &settings.light_sampling);
+            ImGui::Checkbox("Ray packets", &settings.ray_packets);
+            ImGui::Checkbox("Wavefront", &settings.wavefront);
 
-                // Start rendering.
-                camera.image_width = settings.width;
-                camera.image_height = settings.height;
-                camera.samples_per_pixel = settings.samples;
-                camera.max_depth = settings.bounces;
-                camera.fov_vertical = settings.fov;
-                camera.origin = Point3(settings.position[0], settings.position[1], settings.position[2]);
-                camera.direction = UnitVector(Vec3(settings.direction[0], settings.direction[1], settings.direction[2]));
-                camera.direction_up = Vec3(0, 1, 0);
-                camera.defocus_angle = 0;
-                camera.background = Color(255.0 / 255.0, 242 / 255.0, 202.0 / 255.0);
+            if (ImGui::Button("Render") && scene.IsLoaded())
+            {
+                scene_rendered = true;
+                start_render();
+            }
 
-                Hit_List world = MeshLoad(std::string(obj_path));
+            if (rendering)
+            {
+                ImGui::SameLine();
+                if (ImGui::Button("Stop"))
+                {
+                    camera.RequestStop();
+                }
+            }
 
-                camera.Render(world, renderer);
+            // In progressive mode any camera edit throws away the accumulated
+            // samples and starts over with the same world.
+            if (settings.progressive && scene_rendered && (settings == rendered_settings) == false)
+            {
+                start_render();
+            }
 
-                texture = camera.texture;
+            if (rendering && camera.IsRendering() == false)
+            {
+                rendering = false;
 
                 // End timing
                 const auto end = std::chrono::high_resolution_clock::now();
-
-                // Calculate duration in microseconds
-                duration = std::chrono::duration_cast<std::chrono::seconds>(end - start).count();
+                duration = std::chrono::duration_cast<std::chrono::seconds>(end - render_start).count();
             }
 
-            if (texture != nullptr)
+            if (camera.texture != nullptr && rendering == false)
             {
                 if (ImGui::Button("Save as..."))
                 {
@@ -189,18 +529,24 @@ int main()
                         // Write to file.
                         SDL_Log(save_path);
 
-                        if (camera.surface != nullptr)
+                        if (camera.GetImage().WritePNG(save_path) == 0)
                         {
-                            if (IMG_SavePNG(camera.surface, save_path) == false)
-                            {
-                                SDL_Log(SDL_GetError());
-                            }
+                            SDL_Log("Could not write `%s'", save_path);
                         }
                     }
                 }
             }
 
-            ImGui::Text("Render time: %lld seconds", duration);
+            if (rendering)
+            {
+                const auto now = std::chrono::high_resolution_clock::now();
+                const double seconds = std::chrono::duration<double>(now - render_start).count();
+                ImGui::Text("Rendering... %.1f spp, %.1f seconds", camera.AverageSamplesPerPixel(), seconds);
+            }
+            else
+            {
+                ImGui::Text("Render time: %lld seconds, %.1f spp", duration, camera.AverageSamplesPerPixel());
+            }
 
             ImGui::End();
         }
@@ -209,14 +555,21 @@ int main()
         ImGui::Render();
         SDL_SetRenderScale(renderer, io.DisplayFramebufferScale.x, io.DisplayFramebufferScale.y);
 
-        if (texture == nullptr)
+        // Picks up whatever the workers finished since the last frame. That
+        // includes the frame a render ends in, so its last tiles are not lost.
+        if (rendering || camera.texture != nullptr)
+        {
+            camera.UploadTiles(renderer);
+        }
+
+        if (camera.texture == nullptr)
         {
             SDL_SetRenderDrawColor(renderer, 30, 30, 30, SDL_ALPHA_OPAQUE);
             SDL_RenderClear(renderer);
         }
         else
         {
-            SDL_RenderTexture(renderer, texture, NULL, NULL);
+            SDL_RenderTexture(renderer, camera.texture, NULL, NULL);
         }
 
         ImGui_ImplSDLRenderer3_RenderDrawData(ImGui::GetDrawData(), renderer);
@@ -224,6 +577,8 @@ int main()
     }
 
     // Cleanup
+    camera.Cancel();
+
     // [If using SDL_MAIN_USE_CALLBACKS: all code below would likely be your SDL_AppQuit() function]
     ImGui_ImplSDLRenderer3_Shutdown();
     ImGui_ImplSDL3_Shutdown();
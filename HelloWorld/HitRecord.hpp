@@ -0,0 +1,86 @@
+#pragma once
+
+#include "RTWeekend.hpp"
+
+#include "Ray.hpp"
+#include "Vec3.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+class Hittable;
+class Material;
+
+class HitRecord
+{
+public:
+    Point3 point;
+
+    Vec3 normal;
+    bool front_face = false;
+
+    real t = 0;
+
+    // Not owning, the primitive or mesh that was hit keeps its materials alive.
+    // Assigning it costs no reference counting in the middle of traversal.
+    const Material* material = nullptr;
+
+    real u = 0;
+    real v = 0;
+
+    // NOTE: `outward_normal` is assumed to have unit length.
+    void SetFaceNormal(const Ray& ray, const Vec3& outward_normal)
+    {
+        this->front_face = Dot(ray.Direction(), outward_normal) < 0;
+        this->normal = front_face ? outward_normal : -outward_normal;
+    }
+
+    // Ray leaving the surface at `point`. Its origin is pushed off the surface, to
+    // the side `direction` goes to, by an amount that grows with the coordinates
+    // (their rounding error does too), so the ray can start at t = 0 without
+    // hitting the surface it leaves, in float builds as well.
+    Ray SpawnRay(const Vec3& direction, const real time) const
+    {
+        const real scale = std::max({ real(1), std::abs(this->point.x()), std::abs(this->point.y()), std::abs(this->point.z()) });
+        const real offset = Dot(direction, this->normal) < 0 ? -spawn_epsilon * scale : spawn_epsilon * scale;
+
+        return Ray(this->point + offset * this->normal, direction, time);
+    }
+};
+
+// What traversal keeps of a hit: just enough to find the closest one, and to
+// fill in its `HitRecord` once at the end (see `Hittable::Hit()`).
+class Intersection
+{
+public:
+    static constexpr int max_instance_depth = 4;
+
+    real t = 0;
+
+    const Hittable* object = nullptr;  // Primitive that was hit, fills in the surface data.
+    uint32_t primitive = 0;            // Face of a mesh.
+    real b1 = 0;                     // Barycentrics of a triangle, or the plane
+    real b2 = 0;                     // coordinates of a quad.
+
+    // Instance transforms between the root and `object`, innermost first.
+    const Hittable* instances[max_instance_depth];
+    int instance_count = 0;
+
+    // Surface data of a hit below more instances than the stack holds, worked
+    // out when it ran full (see `IntersectInstance()`). `object` is then the
+    // instance that found no room, `normal` the outward normal in the space it
+    // sits in, and `b1` and `b2` the UVs.
+    Vec3 normal;
+    const Material* material = nullptr;
+
+    void Set(const real t, const Hittable* object, const uint32_t primitive = 0, const real b1 = 0, const real b2 = 0)
+    {
+        this->t = t;
+        this->object = object;
+        this->primitive = primitive;
+        this->b1 = b1;
+        this->b2 = b2;
+        this->instance_count = 0;
+    }
+};
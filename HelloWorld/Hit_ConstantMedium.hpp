@@ -1,8 +1,5 @@
 #pragma once
 
-// This is kept in a separate file instead of "Hittable.hpp" because of the
-// circular dependency around "Material.hpp" and "Hittable.hpp".
-
 #include "RTWeekend.hpp"
 
 #include "AABB.hpp"
@@ -25,7 +22,7 @@ class Hit_ConstantMedium : public Hittable
 public:
     Hit_ConstantMedium(
         const shared_ptr<Hittable> boundary,
-        const double density,
+        const real density,
         const shared_ptr<Texture> tex
     ) : boundary(boundary), neg_inv_density(-1 / density),
         phase_function(make_shared<Mat_Isotropic>(tex))
@@ -33,21 +30,22 @@ public:
 
     Hit_ConstantMedium(
         const shared_ptr<Hittable> boundary,
-        const double density,
+        const real density,
         const Color& albedo
     ) : boundary(boundary), neg_inv_density(-1 / density),
         phase_function(make_shared<Mat_Isotropic>(albedo))
     {}
 
-    bool Hit(const Ray& ray, const Interval ray_t, HitRecord& hit_record) const override
+    bool Intersect(const Ray& ray, const Interval ray_t, Intersection& intersection) const override
     {
-        HitRecord rec_1, rec_2;
+        // Only the distances to the boundary are needed.
+        Intersection rec_1, rec_2;
 
-        if (this->boundary->Hit(ray, Interval::Universe, rec_1) == false)
+        if (this->boundary->Intersect(ray, Interval::Universe, rec_1) == false)
         {
             return false;
         }
-        if (this->boundary->Hit(ray, Interval(rec_1.t + 0.0001, infinity), rec_2) == false)
+        if (this->boundary->Intersect(ray, Interval(rec_1.t + 0.0001, infinity), rec_2) == false)
         {
             return false;
         }
@@ -71,27 +69,31 @@ public:
             rec_1.t = 0;
         }
 
-        const double ray_length =
+        const real ray_length =
             ray.Direction().Length();
-        const double distance_inside_boundary =
+        const real distance_inside_boundary =
             (rec_2.t - rec_1.t) * ray_length;
-        const double hit_distance =
-            neg_inv_density * std::log(RandomDouble());
+        const real hit_distance =
+            neg_inv_density * std::log(RandomReal());
 
         if (hit_distance > distance_inside_boundary)
         {
             return false;
         }
 
-        hit_record.t = rec_1.t + hit_distance / ray_length;
+        intersection.Set(rec_1.t + hit_distance / ray_length, this);
+
+        return true;
+    }
+
+    void SetHitRecord(const Ray& ray, const Intersection& intersection, HitRecord& hit_record) const override
+    {
         hit_record.point = ray.At(hit_record.t);
 
         hit_record.normal = Vec3(1, 0, 0); // arbitrary
         hit_record.front_face = true;      // arbitrary
 
-        hit_record.material = phase_function;
-
-        return true;
+        hit_record.material = phase_function.get();
     }
 
     AABB BBox() const override
@@ -101,6 +103,6 @@ public:
 
 private:
     shared_ptr<Hittable> boundary;
-    double neg_inv_density;
+    real neg_inv_density;
     shared_ptr<Material> phase_function;
 };
@@ -0,0 +1,382 @@
+#pragma once
+
+#include "RTWeekend.hpp"
+
+#include "AABB.hpp"
+#include "BVH.hpp"
+#include "Hittable.hpp"
+#include "Interval.hpp"
+#include "Material.hpp"
+#include "Ray.hpp"
+#include "RayPacket.hpp"
+#include "Triangle.hpp"
+#include "Vec2.hpp"
+#include "Vec3.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+using std::make_shared;
+using std::shared_ptr;
+
+// Vertex and index buffers of a triangle mesh. Every attribute lives in its own
+// array, and faces only store 32-bit indices into them, so a vertex shared by
+// several faces is stored once.
+class MeshData
+{
+public:
+    std::vector<Point3> positions;
+    std::vector<Vec2>   uvs;      // Either empty or one per position.
+    std::vector<Vec3>   normals;  // Either empty or one per position.
+
+    std::vector<uint32_t> indices;       // Three per face.
+    std::vector<uint32_t> material_ids;  // One per face, indexes `materials`.
+
+    std::vector<shared_ptr<Material>> materials;
+
+    size_t FaceCount() const
+    {
+        return this->indices.size() / 3;
+    }
+
+    const Point3& Position(const size_t face, const int corner) const
+    {
+        return this->positions[this->indices[3 * face + corner]];
+    }
+
+    real Area(const size_t face) const
+    {
+        const Point3& p0 = Position(face, 0);
+        return Cross(Position(face, 1) - p0, Position(face, 2) - p0).Length() / 2;
+    }
+
+    // Texture coordinates at the barycentrics `(b1, b2)` of `face`, (0, 0) for a
+    // mesh without them.
+    void UV(const size_t face, const real b1, const real b2, real& u, real& v) const
+    {
+        if (this->uvs.empty())
+        {
+            u = 0;
+            v = 0;
+            return;
+        }
+
+        const Vec2 uv =
+            (1 - b1 - b2) * this->uvs[this->indices[3 * face + 0]] +
+            b1            * this->uvs[this->indices[3 * face + 1]] +
+            b2            * this->uvs[this->indices[3 * face + 2]];
+        u = uv.x();
+        v = uv.y();
+    }
+
+    // Expects `hit_record.t` to be set already.
+    void SetHitRecord(const Ray& ray, const uint32_t face, const real b1, const real b2, HitRecord& hit_record) const
+    {
+        const uint32_t i0 = this->indices[3 * face + 0];
+        const uint32_t i1 = this->indices[3 * face + 1];
+        const uint32_t i2 = this->indices[3 * face + 2];
+        const real b0 = 1 - b1 - b2;
+
+        hit_record.point = ray.At(hit_record.t);
+
+        const Vec3 geometric_normal = UnitVector(Cross(
+            this->positions[i1] - this->positions[i0],
+            this->positions[i2] - this->positions[i0]
+        ));
+        hit_record.SetFaceNormal(ray, geometric_normal);
+
+        if (this->normals.empty() == false)
+        {
+            // Smooth shading, kept on the side of the surface the ray came from.
+            const Vec3 shading_normal = b0 * this->normals[i0] + b1 * this->normals[i1] + b2 * this->normals[i2];
+            if (shading_normal.NearZero() == false)
+            {
+                const Vec3 unit_normal = UnitVector(shading_normal);
+                hit_record.normal = Dot(unit_normal, hit_record.normal) < 0 ? -unit_normal : unit_normal;
+            }
+        }
+
+        UV(face, b1, b2, hit_record.u, hit_record.v);
+
+        hit_record.material = this->materials[this->material_ids[face]].get();
+    }
+
+    size_t MemoryUsage() const
+    {
+        return
+            this->positions.capacity()    * sizeof(Point3) +
+            this->uvs.capacity()          * sizeof(Vec2) +
+            this->normals.capacity()      * sizeof(Vec3) +
+            this->indices.capacity()      * sizeof(uint32_t) +
+            this->material_ids.capacity() * sizeof(uint32_t);
+    }
+};
+
+// The emissive faces of a mesh, as a single light. `Random()` picks a face with
+// probability proportional to its area and then a uniform point on it, so every
+// point of the emitting surface is equally likely.
+class Hit_MeshLight : public Hittable
+{
+public:
+    Hit_MeshLight(const shared_ptr<const MeshData> mesh, std::vector<uint32_t> faces) :
+        mesh(mesh), faces(std::move(faces))
+    {
+        std::vector<AABB> boxes(this->faces.size());
+        this->cumulative_areas.resize(this->faces.size());
+
+        for (size_t i = 0; i < this->faces.size(); ++i)
+        {
+            const uint32_t face = this->faces[i];
+            const Point3& p0 = this->mesh->Position(face, 0);
+            const Point3& p1 = this->mesh->Position(face, 1);
+            const Point3& p2 = this->mesh->Position(face, 2);
+
+            boxes[i] = AABB(AABB(p0, p1), AABB(p2, p2));
+
+            this->total_area += this->mesh->Area(face);
+            this->cumulative_areas[i] = this->total_area;
+        }
+
+        this->bvh.Build(boxes);
+    }
+
+    bool Intersect(const Ray& ray, const Interval ray_t, Intersection& intersection) const override
+    {
+        return this->bvh.Traverse(ray, ray_t, [&](const uint32_t index, Interval& t)
+        {
+            const uint32_t face = this->faces[index];
+            const Point3& p0 = this->mesh->Position(face, 0);
+
+            real t_face, b1, b2;
+            if (IntersectTriangle(ray, t, p0, this->mesh->Position(face, 1) - p0, this->mesh->Position(face, 2) - p0, t_face, b1, b2) == false)
+            {
+                return false;
+            }
+
+            t.max = t_face;
+            intersection.Set(t_face, this, face, b1, b2);
+            return true;
+        });
+    }
+
+    void SetHitRecord(const Ray& ray, const Intersection& intersection, HitRecord& hit_record) const override
+    {
+        this->mesh->SetHitRecord(ray, intersection.primitive, intersection.b1, intersection.b2, hit_record);
+    }
+
+    bool Occluded(const Ray& ray, const Interval ray_t) const override
+    {
+        return this->bvh.TraverseAny(ray, ray_t, [&](const uint32_t index, Interval& t)
+        {
+            const uint32_t face = this->faces[index];
+            const Point3& p0 = this->mesh->Position(face, 0);
+
+            real t_face, b1, b2;
+            return IntersectTriangle(ray, t, p0, this->mesh->Position(face, 1) - p0, this->mesh->Position(face, 2) - p0, t_face, b1, b2);
+        });
+    }
+
+    AABB BBox() const override
+    {
+        return this->bvh.BBox();
+    }
+
+    real PdfValue(const Ray& ray, const Interval ray_t) const override
+    {
+        Intersection intersection;
+        if (Intersect(ray, ray_t, intersection) == false)
+        {
+            return 0;
+        }
+
+        return SolidAngleDensity(intersection.t * ray.Direction(), this->FaceNormal(intersection.primitive), this->total_area);
+    }
+
+    LightSample Random(const Point3& origin) const override
+    {
+        const real target = RandomReal() * this->total_area;
+        const size_t i = std::min(
+            size_t(std::upper_bound(this->cumulative_areas.begin(), this->cumulative_areas.end(), target) - this->cumulative_areas.begin()),
+            this->faces.size() - 1
+        );
+        const uint32_t face = this->faces[i];
+
+        // Uniform point on the triangle.
+        const real s = std::sqrt(RandomReal());
+        const real r = RandomReal();
+        const real b1 = s * (1 - r);
+        const real b2 = s * r;
+
+        LightSample sample;
+        sample.point =
+            (1 - s) * this->mesh->Position(face, 0) +
+            b1      * this->mesh->Position(face, 1) +
+            b2      * this->mesh->Position(face, 2);
+        sample.normal = this->FaceNormal(face);
+
+        real u, v;
+        this->mesh->UV(face, b1, b2, u, v);
+        sample.emitted = this->mesh->materials[this->mesh->material_ids[face]]->Emit(u, v, sample.point);
+        sample.pdf = SolidAngleDensity(sample.point - origin, sample.normal, this->total_area);
+
+        return sample;
+    }
+
+private:
+    shared_ptr<const MeshData> mesh;
+    std::vector<uint32_t> faces;
+    std::vector<real> cumulative_areas;
+    real total_area = 0;
+    BVH bvh;
+
+    Vec3 FaceNormal(const uint32_t face) const
+    {
+        const Point3& p0 = this->mesh->Position(face, 0);
+        return UnitVector(Cross(this->mesh->Position(face, 1) - p0, this->mesh->Position(face, 2) - p0));
+    }
+};
+
+class Hit_TriangleMesh : public Hittable
+{
+public:
+    Hit_TriangleMesh(const shared_ptr<const MeshData> mesh, const BVHSplitMethod method = BVHSplitMethod::SAH) :
+        Hit_TriangleMesh(mesh, BuildBVH(*mesh, method))
+    {
+    }
+
+    // Uses a hierarchy over the faces of `mesh` that was built before.
+    Hit_TriangleMesh(const shared_ptr<const MeshData> mesh, BVH bvh) :
+        mesh(mesh), bvh(std::move(bvh))
+    {
+    }
+
+    static BVH BuildBVH(const MeshData& mesh, const BVHSplitMethod method = BVHSplitMethod::SAH)
+    {
+        std::vector<AABB> boxes(mesh.FaceCount());
+        for (size_t face = 0; face < boxes.size(); ++face)
+        {
+            const Point3& p0 = mesh.Position(face, 0);
+            const Point3& p1 = mesh.Position(face, 1);
+            const Point3& p2 = mesh.Position(face, 2);
+
+            boxes[face] = AABB(AABB(p0, p1), AABB(p2, p2));
+        }
+
+        BVH bvh;
+        bvh.Build(boxes, method);
+        return bvh;
+    }
+
+    bool Intersect(const Ray& ray, const Interval ray_t, Intersection& intersection) const override
+    {
+        return this->bvh.Traverse(ray, ray_t, [&](const uint32_t face, Interval& t)
+        {
+            const Point3& p0 = this->mesh->Position(face, 0);
+
+            real t_face, b1, b2;
+            if (IntersectTriangle(ray, t, p0, this->mesh->Position(face, 1) - p0, this->mesh->Position(face, 2) - p0, t_face, b1, b2) == false)
+            {
+                return false;
+            }
+
+            t.max = t_face;
+            intersection.Set(t_face, this, face, b1, b2);
+            return true;
+        });
+    }
+
+    uint32_t IntersectPacket(RayPacket& packet, const uint32_t active, Intersection intersections[]) const override
+    {
+        return this->bvh.TraversePacket(packet, active, [&](const uint32_t face, const uint32_t lanes)
+        {
+            const Point3& p0 = this->mesh->Position(face, 0);
+            const Vec3 edge_1 = this->mesh->Position(face, 1) - p0;
+            const Vec3 edge_2 = this->mesh->Position(face, 2) - p0;
+
+            uint32_t hit_lanes = 0;
+            RayPacket::ForEachLane(lanes, [&](const int lane)
+            {
+                real t_face, b1, b2;
+                if (IntersectTriangle(packet.rays[lane], packet.LaneInterval(lane), p0, edge_1, edge_2, t_face, b1, b2))
+                {
+                    packet.t_max[lane] = t_face;
+                    intersections[lane].Set(t_face, this, face, b1, b2);
+                    hit_lanes |= 1u << lane;
+                }
+            });
+
+            return hit_lanes;
+        });
+    }
+
+    void SetHitRecord(const Ray& ray, const Intersection& intersection, HitRecord& hit_record) const override
+    {
+        this->mesh->SetHitRecord(ray, intersection.primitive, intersection.b1, intersection.b2, hit_record);
+    }
+
+    bool Occluded(const Ray& ray, const Interval ray_t) const override
+    {
+        return this->bvh.TraverseAny(ray, ray_t, [&](const uint32_t face, Interval& t)
+        {
+            const Point3& p0 = this->mesh->Position(face, 0);
+
+            real t_face, b1, b2;
+            return IntersectTriangle(ray, t, p0, this->mesh->Position(face, 1) - p0, this->mesh->Position(face, 2) - p0, t_face, b1, b2);
+        });
+    }
+
+    AABB BBox() const override
+    {
+        return this->bvh.BBox();
+    }
+
+    // All emissive faces become one `Hit_MeshLight`.
+    void CollectLights(Hit_List& lights) const override
+    {
+        std::vector<uint32_t> emissive_faces;
+        for (uint32_t face = 0; face < this->mesh->FaceCount(); ++face)
+        {
+            if (this->mesh->materials[this->mesh->material_ids[face]]->IsEmissive())
+            {
+                emissive_faces.push_back(face);
+            }
+        }
+
+        if (emissive_faces.empty() == false)
+        {
+            lights.Add(make_shared<Hit_MeshLight>(this->mesh, std::move(emissive_faces)));
+        }
+    }
+
+    const BVHStats& Stats() const
+    {
+        return this->bvh.Stats();
+    }
+
+    const MeshData& Mesh() const
+    {
+        return *this->mesh;
+    }
+
+    const BVH& Bvh() const
+    {
+        return this->bvh;
+    }
+
+    // Bytes used by the mesh buffers and the acceleration structure.
+    size_t MemoryUsage() const
+    {
+        return
+            this->mesh->MemoryUsage() +
+            this->bvh.nodes.capacity()   * sizeof(BVHNode) +
+            this->bvh.indices.capacity() * sizeof(uint32_t);
+    }
+
+private:
+    shared_ptr<const MeshData> mesh;
+    BVH bvh;
+};
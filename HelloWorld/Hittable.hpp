@@ -3,54 +3,194 @@
 #include "RTWeekend.hpp"
 
 #include "AABB.hpp"
+#include "BVH.hpp"
+#include "HitRecord.hpp"
 #include "Interval.hpp"
+#include "Material.hpp"
+#include "Onb.hpp"
 #include "Ray.hpp"
+#include "RayPacket.hpp"
+#include "Triangle.hpp"
 #include "Vec2.hpp"
 #include "Vec3.hpp"
 
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <cstdlib>
 #include <iterator>
 #include <memory>
+#include <utility>
 #include <vector>
 
 using std::make_shared;
 using std::shared_ptr;
 
-class Material;
+class Hit_List;
 
-class HitRecord
+// A point on a light picked by `Hittable::Random()`, with all that light
+// sampling needs to know about it.
+class LightSample
 {
 public:
     Point3 point;
+    Vec3 normal;    // Geometric normal, facing either way.
+    Color emitted;  // Emission at `point`.
+    real pdf = 0;   // Per solid angle as seen from the origin it was picked for, 0 if it can't be used.
+};
 
-    Vec3 normal;
-    bool front_face = false;
-
-    double t = 0;
-
-    shared_ptr<Material> material;
-
-    double u = 0;
-    double v = 0;
-
-    // NOTE: `outward_normal` is assumed to have unit length.
-    void SetFaceNormal(const Ray& ray, const Vec3& outward_normal)
+// Density per solid angle of a point picked uniformly on a surface of `area`,
+// seen along `direction` (from the origin to the point) where the surface has
+// the unit normal `normal`. 0 for a surface seen edge-on.
+inline real SolidAngleDensity(const Vec3& direction, const Vec3& normal, const real area)
+{
+    const real distance_squared = direction.LengthSquared();
+    const real cosine = std::fabs(Dot(direction, normal)) / std::sqrt(distance_squared);
+    if (cosine <= 0)
     {
-        this->front_face = Dot(ray.Direction(), outward_normal) < 0;
-        this->normal = front_face ? outward_normal : -outward_normal;
+        return 0;
     }
-};
+
+    return distance_squared / (cosine * area);
+}
 
 class Hittable
 {
 public:
     virtual ~Hittable() = default;
 
-    virtual bool Hit(const Ray& ray, const Interval ray_t, HitRecord& hit_record) const = 0;
+    // Closest hit within `ray_t`, with all of its surface data.
+    bool Hit(const Ray& ray, const Interval ray_t, HitRecord& hit_record) const
+    {
+        Intersection intersection;
+        if (Intersect(ray, ray_t, intersection) == false)
+        {
+            return false;
+        }
+
+        FillHitRecord(ray, intersection, hit_record);
+        return true;
+    }
+
+    // `Hit()` for the lanes `active` of a packet, each within its own interval.
+    // Returns the lanes that hit, only their `hit_records` are filled in.
+    uint32_t HitPacket(RayPacket& packet, const uint32_t active, HitRecord hit_records[]) const
+    {
+        Intersection intersections[RayPacket::size];
+        const uint32_t hit_lanes = IntersectPacket(packet, active, intersections);
+
+        RayPacket::ForEachLane(hit_lanes, [&](const int lane)
+        {
+            FillHitRecord(packet.rays[lane], intersections[lane], hit_records[lane]);
+        });
+
+        return hit_lanes;
+    }
+
+    // Finds the closest hit within `ray_t` but only records which primitive it
+    // is on and where (see `Intersection`). Leaves `intersection` untouched when
+    // there is no hit.
+    virtual bool Intersect(const Ray& ray, const Interval ray_t, Intersection& intersection) const = 0;
+
+    // `Intersect()` for the lanes `active` of a packet. A lane that hits gets its
+    // intersection and has `packet.t_max` shrunk to it. Returns the lanes that
+    // hit. By default the lanes go one by one, hierarchies override it to test
+    // their boxes against the whole packet.
+    virtual uint32_t IntersectPacket(RayPacket& packet, const uint32_t active, Intersection intersections[]) const
+    {
+        uint32_t hit_lanes = 0;
+
+        RayPacket::ForEachLane(active, [&](const int lane)
+        {
+            if (packet.generators != nullptr)
+            {
+                std::swap(RandomGenerator(), packet.generators[lane]);
+            }
+
+            if (Intersect(packet.rays[lane], packet.LaneInterval(lane), intersections[lane]))
+            {
+                packet.t_max[lane] = intersections[lane].t;
+                hit_lanes |= 1u << lane;
+            }
+
+            if (packet.generators != nullptr)
+            {
+                std::swap(RandomGenerator(), packet.generators[lane]);
+            }
+        });
+
+        return hit_lanes;
+    }
+
+    // Fills in the surface data of a hit this primitive reported from
+    // `Intersect()`. `ray` is in the primitive's own space and
+    // `hit_record.t` is already set.
+    virtual void SetHitRecord(const Ray& ray, const Intersection& intersection, HitRecord& hit_record) const {}
+
+    // Instance transforms: the ray in the space of the wrapped object, and the
+    // surface data from there back to world space.
+    virtual Ray RayToObject(const Ray& ray) const
+    {
+        return ray;
+    }
+
+    virtual void RecordToWorld(HitRecord& hit_record) const {}
+
+    // Whether anything blocks `ray` within `ray_t`. Unlike `Intersect()` it
+    // doesn't need the closest hit, so overrides return on the first hit they
+    // find.
+    virtual bool Occluded(const Ray& ray, const Interval ray_t) const
+    {
+        Intersection intersection;
+        return Intersect(ray, ray_t, intersection);
+    }
 
     virtual AABB BBox() const = 0;
+
+    // Light sampling. `Random()` picks a point on the object to light `origin`
+    // with, and `PdfValue()` is the density (per solid angle) of it picking the
+    // point `ray` hits first within `ray_t`, as seen from the ray's origin, or 0
+    // if it hits none there. Only objects that can be lights need these.
+    virtual real PdfValue(const Ray& ray, const Interval ray_t) const
+    {
+        return 0;
+    }
+
+    virtual LightSample Random(const Point3& origin) const
+    {
+        return LightSample();
+    }
+
+    // True for primitives with an emissive material.
+    virtual bool IsEmissive() const
+    {
+        return false;
+    }
+
+    // Adds every emissive primitive below this object to `lights`. Objects that
+    // hold other objects override this, primitives are picked up by their parent
+    // through `IsEmissive()`.
+    virtual void CollectLights(Hit_List& lights) const {}
+
+    // Surface data is only worked out here, once per hit. The instances in
+    // between move the ray into the space of the primitive and the result back
+    // out.
+    static void FillHitRecord(const Ray& ray, const Intersection& intersection, HitRecord& hit_record)
+    {
+        Ray local_ray = ray;
+        for (int i = intersection.instance_count - 1; i >= 0; --i)
+        {
+            local_ray = intersection.instances[i]->RayToObject(local_ray);
+        }
+
+        hit_record.t = intersection.t;
+        intersection.object->SetHitRecord(local_ray, intersection, hit_record);
+
+        for (int i = 0; i < intersection.instance_count; ++i)
+        {
+            intersection.instances[i]->RecordToWorld(hit_record);
+        }
+    }
 };
 
 class Hit_List : public Hittable
@@ -81,35 +221,104 @@ public:
         return this->bbox;
     }
 
-    bool Hit(const Ray& ray, const Interval ray_t, HitRecord& record) const override
+    bool Intersect(const Ray& ray, const Interval ray_t, Intersection& intersection) const override
     {
-        HitRecord temp_record;
         bool hit_anything = false;
-        double closest_so_far = ray_t.max;
+        real closest_so_far = ray_t.max;
 
         for (const shared_ptr<Hittable>& object : objects)
         {
-            if (object->Hit(ray, Interval(ray_t.min, closest_so_far), temp_record))
+            if (object->Intersect(ray, Interval(ray_t.min, closest_so_far), intersection))
             {
                 hit_anything = true;
 
                 // Imagine ray hitting sphere that is 1 unit away from the camera.
-                // By storing 'closest_so_far' and using it in Hit() function the
+                // By storing 'closest_so_far' and using it in Intersect() function the
                 // ray won't hit the sphere that is 2 units away. I.e. we will not
                 // hit objects that are behind the closest object. Makes sense ;)
                 //
                 // I just came back to this code in 2025 (it is a year later now)
                 // and I want to thank myself for providing an explanation to my
                 // future self.
-                closest_so_far = temp_record.t;
-
-                record = temp_record;
+                closest_so_far = intersection.t;
             }
         }
 
         return hit_anything;
     }
 
+    uint32_t IntersectPacket(RayPacket& packet, const uint32_t active, Intersection intersections[]) const override
+    {
+        uint32_t hit_lanes = 0;
+        for (const shared_ptr<Hittable>& object : objects)
+        {
+            hit_lanes |= object->IntersectPacket(packet, active, intersections);
+        }
+
+        return hit_lanes;
+    }
+
+    bool Occluded(const Ray& ray, const Interval ray_t) const override
+    {
+        for (const shared_ptr<Hittable>& object : objects)
+        {
+            if (object->Occluded(ray, ray_t))
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // Sampling the list picks one of its objects uniformly, so the density is the
+    // average of theirs.
+    real PdfValue(const Ray& ray, const Interval ray_t) const override
+    {
+        if (this->objects.empty())
+        {
+            return 0;
+        }
+
+        real sum = 0;
+        for (const shared_ptr<Hittable>& object : this->objects)
+        {
+            sum += object->PdfValue(ray, ray_t);
+        }
+
+        return sum / real(this->objects.size());
+    }
+
+    LightSample Random(const Point3& origin) const override
+    {
+        const int index = RandomInt(0, int(this->objects.size()) - 1);
+
+        LightSample sample = this->objects[index]->Random(origin);
+        sample.pdf /= real(this->objects.size());
+        return sample;
+    }
+
+    void CollectLights(Hit_List& lights) const override
+    {
+        for (const shared_ptr<Hittable>& object : this->objects)
+        {
+            CollectLight(object, lights);
+        }
+    }
+
+    // Adds `object` itself if it is emissive, or the lights it holds otherwise.
+    static void CollectLight(const shared_ptr<Hittable>& object, Hit_List& lights)
+    {
+        if (object->IsEmissive())
+        {
+            lights.Add(object);
+        }
+        else
+        {
+            object->CollectLights(lights);
+        }
+    }
+
 private:
     AABB bbox;
 };
@@ -163,12 +372,12 @@ public:
         }
     }
 
-    bool Hit(const Ray& ray, Interval ray_t, HitRecord& hit_record) const override
+    bool Intersect(const Ray& ray, const Interval ray_t, Intersection& intersection) const override
     {
         if (this->bbox.Hit(ray, ray_t))
         {
-            const bool hit_left = this->left->Hit(ray, ray_t, hit_record);
-            const bool hit_right = this->right->Hit(ray, Interval(ray_t.min, hit_left ? hit_record.t : ray_t.max), hit_record);
+            const bool hit_left = this->left->Intersect(ray, ray_t, intersection);
+            const bool hit_right = this->right->Intersect(ray, Interval(ray_t.min, hit_left ? intersection.t : ray_t.max), intersection);
 
             return hit_left || hit_right;
         }
@@ -176,11 +385,41 @@ public:
         return false;
     }
 
+    uint32_t IntersectPacket(RayPacket& packet, const uint32_t active, Intersection intersections[]) const override
+    {
+        const uint32_t lanes = packet.Hit(this->bbox, active);
+        if (lanes == 0)
+        {
+            return 0;
+        }
+
+        const uint32_t hit_left = this->left->IntersectPacket(packet, lanes, intersections);
+        const uint32_t hit_right = this->right->IntersectPacket(packet, lanes, intersections);
+
+        return hit_left | hit_right;
+    }
+
+    bool Occluded(const Ray& ray, const Interval ray_t) const override
+    {
+        return this->bbox.Hit(ray, ray_t) && (this->left->Occluded(ray, ray_t) || this->right->Occluded(ray, ray_t));
+    }
+
     AABB BBox() const override
     {
         return this->bbox;
     }
 
+    void CollectLights(Hit_List& lights) const override
+    {
+        Hit_List::CollectLight(this->left, lights);
+
+        // A node over a single object has it on both sides.
+        if (this->right != this->left)
+        {
+            Hit_List::CollectLight(this->right, lights);
+        }
+    }
+
 private:
     shared_ptr<Hittable> left;
     shared_ptr<Hittable> right;
@@ -207,6 +446,120 @@ private:
     }
 };
 
+class Hit_LinearBVH : public Hittable
+{
+public:
+    // Same role as `Hit_BVHNode`, but the hierarchy lives in one contiguous array
+    // and is walked with an explicit stack. Only the primitives in the leaves are
+    // reached through virtual calls.
+    Hit_LinearBVH(const Hit_List& list, const BVHSplitMethod method = BVHSplitMethod::SAH) :
+        objects(list.objects)
+    {
+        std::vector<AABB> boxes(this->objects.size());
+        for (size_t i = 0; i < this->objects.size(); ++i)
+        {
+            boxes[i] = this->objects[i]->BBox();
+        }
+
+        this->bvh.Build(boxes, method);
+    }
+
+    bool Intersect(const Ray& ray, const Interval ray_t, Intersection& intersection) const override
+    {
+        return this->bvh.Traverse(ray, ray_t, [&](const uint32_t index, Interval& t)
+        {
+            if (this->objects[index]->Intersect(ray, t, intersection) == false)
+            {
+                return false;
+            }
+
+            t.max = intersection.t;
+            return true;
+        });
+    }
+
+    uint32_t IntersectPacket(RayPacket& packet, const uint32_t active, Intersection intersections[]) const override
+    {
+        return this->bvh.TraversePacket(packet, active, [&](const uint32_t index, const uint32_t lanes)
+        {
+            return this->objects[index]->IntersectPacket(packet, lanes, intersections);
+        });
+    }
+
+    bool Occluded(const Ray& ray, const Interval ray_t) const override
+    {
+        return this->bvh.TraverseAny(ray, ray_t, [&](const uint32_t index, Interval& t)
+        {
+            return this->objects[index]->Occluded(ray, t);
+        });
+    }
+
+    AABB BBox() const override
+    {
+        return this->bvh.BBox();
+    }
+
+    const BVHStats& Stats() const
+    {
+        return this->bvh.Stats();
+    }
+
+    void CollectLights(Hit_List& lights) const override
+    {
+        for (const shared_ptr<Hittable>& object : this->objects)
+        {
+            Hit_List::CollectLight(object, lights);
+        }
+    }
+
+private:
+    std::vector<shared_ptr<Hittable>> objects;
+    BVH bvh;
+};
+
+// `Intersect()` of an instance transform: intersects `object` in its own space
+// and adds `instance` to the hit's instance stack. When the stack is already
+// full the hit's surface data is worked out right away and kept in the
+// `Intersection` instead, so deeper nesting costs more but is still hit.
+inline bool IntersectInstance(const Hittable& instance, const Hittable& object, const Ray& ray, const Interval ray_t, Intersection& intersection)
+{
+    Intersection inner;
+    const Ray object_ray = instance.RayToObject(ray);
+    if (object.Intersect(object_ray, ray_t, inner) == false)
+    {
+        return false;
+    }
+
+    if (inner.instance_count == Intersection::max_instance_depth)
+    {
+        HitRecord hit_record;
+        Hittable::FillHitRecord(object_ray, inner, hit_record);
+        instance.RecordToWorld(hit_record);
+
+        intersection.Set(inner.t, &instance, 0, hit_record.u, hit_record.v);
+        intersection.normal = hit_record.front_face ? hit_record.normal : -hit_record.normal;
+        intersection.material = hit_record.material;
+
+        return true;
+    }
+
+    inner.instances[inner.instance_count++] = &instance;
+    intersection = inner;
+
+    return true;
+}
+
+// `SetHitRecord()` of an instance transform, which is only ever the hit object
+// when `IntersectInstance()` found its stack full.
+inline void SetInstanceHitRecord(const Ray& ray, const Intersection& intersection, HitRecord& hit_record)
+{
+    hit_record.point = ray.At(intersection.t);
+    hit_record.SetFaceNormal(ray, intersection.normal);
+    hit_record.material = intersection.material;
+    hit_record.u = intersection.b1;
+    hit_record.v = intersection.b2;
+}
+
 class Hit_Translate : public Hittable
 {
 public:
@@ -216,18 +569,29 @@ public:
         this->bbox = this->object->BBox() + offset;
     }
 
-    bool Hit(const Ray& ray, const Interval ray_t, HitRecord& hit_record) const override
+    bool Intersect(const Ray& ray, const Interval ray_t, Intersection& intersection) const override
     {
-        const Ray ray_offset = Ray(ray.Origin() - offset, ray.Direction(), ray.Time());
+        return IntersectInstance(*this, *this->object, ray, ray_t, intersection);
+    }
 
-        if (this->object->Hit(ray_offset, ray_t, hit_record) == false)
-        {
-            return false;
-        }
+    void SetHitRecord(const Ray& ray, const Intersection& intersection, HitRecord& hit_record) const override
+    {
+        SetInstanceHitRecord(ray, intersection, hit_record);
+    }
+
+    Ray RayToObject(const Ray& ray) const override
+    {
+        return Ray(ray.Origin() - offset, ray.Direction(), ray.Time());
+    }
 
+    void RecordToWorld(HitRecord& hit_record) const override
+    {
         hit_record.point += offset;
+    }
 
-        return true;
+    bool Occluded(const Ray& ray, const Interval ray_t) const override
+    {
+        return this->object->Occluded(RayToObject(ray), ray_t);
     }
 
     AABB BBox() const override
@@ -235,6 +599,30 @@ public:
         return this->bbox;
     }
 
+    real PdfValue(const Ray& ray, const Interval ray_t) const override
+    {
+        return this->object->PdfValue(RayToObject(ray), ray_t);
+    }
+
+    LightSample Random(const Point3& origin) const override
+    {
+        LightSample sample = this->object->Random(origin - offset);
+        sample.point += offset;
+        return sample;
+    }
+
+    // The lights inside are moved along with everything else.
+    void CollectLights(Hit_List& lights) const override
+    {
+        Hit_List inner;
+        Hit_List::CollectLight(this->object, inner);
+
+        for (const shared_ptr<Hittable>& light : inner.objects)
+        {
+            lights.Add(make_shared<Hit_Translate>(light, this->offset));
+        }
+    }
+
 private:
     shared_ptr<Hittable> object;
     Vec3 offset;
@@ -244,10 +632,10 @@ private:
 class Hit_RotateY : public Hittable
 {
 public:
-    Hit_RotateY(shared_ptr<Hittable> object, const double angle) :
-        object(object)
+    Hit_RotateY(shared_ptr<Hittable> object, const real angle) :
+        object(object), angle(angle)
     {
-        const double radians = DegreesToRadians(angle);
+        const real radians = DegreesToRadians(angle);
         this->sin_theta = std::sin(radians);
         this->cos_theta = std::cos(radians);
         this->bbox = object->BBox();
@@ -261,12 +649,12 @@ public:
             {
                 for (int k = 0; k < 2; ++k)
                 {
-                    const double x = i * bbox.x.max + (1 - i) * bbox.x.min;
-                    const double y = j * bbox.y.max + (1 - j) * bbox.y.min;
-                    const double z = k * bbox.z.max + (1 - k) * bbox.z.min;
+                    const real x = i * bbox.x.max + (1 - i) * bbox.x.min;
+                    const real y = j * bbox.y.max + (1 - j) * bbox.y.min;
+                    const real z = k * bbox.z.max + (1 - k) * bbox.z.min;
 
-                    const double x_new =  this->cos_theta * x + this->sin_theta * z;
-                    const double z_new = -this->sin_theta * x + this->cos_theta * z;
+                    const real x_new =  this->cos_theta * x + this->sin_theta * z;
+                    const real z_new = -this->sin_theta * x + this->cos_theta * z;
                     
                     const Vec3 tester(x_new, y, z_new);
 
@@ -282,43 +670,32 @@ public:
         this->bbox = AABB(min, max);
     }
 
-    bool Hit(const Ray& ray, const Interval ray_t, HitRecord& hit_record) const override
+    bool Intersect(const Ray& ray, const Interval ray_t, Intersection& intersection) const override
     {
-        // Transform the ray from world space to object space.
-        //
-
-        const Point3 origin = Point3(
-            (cos_theta * ray.Origin().x()) - (sin_theta * ray.Origin().z()),
-            ray.Origin().y(),
-            (sin_theta * ray.Origin().x()) + (cos_theta * ray.Origin().z())
-        );
-        const Vec3 direction = Vec3(
-            (cos_theta * ray.Direction().x()) - (sin_theta * ray.Direction().z()),
-            ray.Direction().y(),
-            (sin_theta * ray.Direction().x()) + (cos_theta * ray.Direction().z())
-        );
-        const Ray ray_rotated(origin, direction, ray.Time());
+        return IntersectInstance(*this, *this->object, ray, ray_t, intersection);
+    }
 
-        if (object->Hit(ray_rotated, ray_t, hit_record) == false)
-        {
-            return false;
-        }
+    void SetHitRecord(const Ray& ray, const Intersection& intersection, HitRecord& hit_record) const override
+    {
+        SetInstanceHitRecord(ray, intersection, hit_record);
+    }
 
-        // Transform the intersection from object space back to world space.
-        //
+    // Rotating keeps lengths, so distances along the ray are the same in both
+    // spaces.
+    Ray RayToObject(const Ray& ray) const override
+    {
+        return Ray(ToObject(ray.Origin()), ToObject(ray.Direction()), ray.Time());
+    }
 
-        hit_record.point = Point3(
-            (cos_theta * hit_record.point.x()) + (sin_theta * hit_record.point.z()),
-            hit_record.point.y(),
-            (-sin_theta * hit_record.point.x()) + (cos_theta * hit_record.point.z())
-        );
-        hit_record.normal = Vec3(
-            (cos_theta * hit_record.normal.x()) + (sin_theta * hit_record.normal.z()),
-            hit_record.normal.y(),
-            (-sin_theta * hit_record.normal.x()) + (cos_theta * hit_record.normal.z())
-        );
+    void RecordToWorld(HitRecord& hit_record) const override
+    {
+        hit_record.point = ToWorld(hit_record.point);
+        hit_record.normal = ToWorld(hit_record.normal);
+    }
 
-        return true;
+    bool Occluded(const Ray& ray, const Interval ray_t) const override
+    {
+        return this->object->Occluded(RayToObject(ray), ray_t);
     }
 
     AABB BBox() const override
@@ -326,27 +703,71 @@ public:
         return this->bbox;
     }
 
+    real PdfValue(const Ray& ray, const Interval ray_t) const override
+    {
+        return this->object->PdfValue(RayToObject(ray), ray_t);
+    }
+
+    LightSample Random(const Point3& origin) const override
+    {
+        LightSample sample = this->object->Random(ToObject(origin));
+        sample.point = ToWorld(sample.point);
+        sample.normal = ToWorld(sample.normal);
+        return sample;
+    }
+
+    // The lights inside are rotated along with everything else.
+    void CollectLights(Hit_List& lights) const override
+    {
+        Hit_List inner;
+        Hit_List::CollectLight(this->object, inner);
+
+        for (const shared_ptr<Hittable>& light : inner.objects)
+        {
+            lights.Add(make_shared<Hit_RotateY>(light, this->angle));
+        }
+    }
+
 private:
     shared_ptr<Hittable> object;
-    double sin_theta;
-    double cos_theta;
+    real angle;
+    real sin_theta;
+    real cos_theta;
     AABB bbox;
+
+    Vec3 ToObject(const Vec3& v) const
+    {
+        return Vec3(
+            (cos_theta * v.x()) - (sin_theta * v.z()),
+            v.y(),
+            (sin_theta * v.x()) + (cos_theta * v.z())
+        );
+    }
+
+    Vec3 ToWorld(const Vec3& v) const
+    {
+        return Vec3(
+            (cos_theta * v.x()) + (sin_theta * v.z()),
+            v.y(),
+            (-sin_theta * v.x()) + (cos_theta * v.z())
+        );
+    }
 };
 
 class Hit_Sphere : public Hittable
 {
 public:
     // Stationary sphere.
-    Hit_Sphere(const Point3& static_center, const double radius, const shared_ptr<Material> material) :
-        center(static_center, Vec3(0, 0, 0)), radius(std::max(0.0, radius)), material(material)
+    Hit_Sphere(const Point3& static_center, const real radius, const shared_ptr<Material> material) :
+        center(static_center, Vec3(0, 0, 0)), radius(std::max(real(0), radius)), material(material)
     {
         const Vec3 rvec = Vec3(radius, radius, radius);
         this->bbox = AABB(static_center - rvec, static_center + rvec);
     }
 
     // Moving sphere.
-    Hit_Sphere(const Point3& center_0, const Point3& center_1, const double radius, const shared_ptr<Material> material) :
-        center(center_0, center_1 - center_0), radius(std::max(0.0, radius)), material(material)
+    Hit_Sphere(const Point3& center_0, const Point3& center_1, const real radius, const shared_ptr<Material> material) :
+        center(center_0, center_1 - center_0), radius(std::max(real(0), radius)), material(material)
     {
         const Vec3 rvec = Vec3(radius, radius, radius);
         const AABB bbox_0(center.At(0) - rvec, center.At(0) + rvec);
@@ -354,36 +775,22 @@ public:
         this->bbox = AABB(bbox_0, bbox_1);
     }
 
-    bool Hit(const Ray& ray, const Interval ray_t, HitRecord& hit_record) const override
+    bool Intersect(const Ray& ray, const Interval ray_t, Intersection& intersection) const override
     {
-        const Point3 current_center = center.At(ray.Time());
-
-        const Vec3 OC = current_center - ray.Origin();
-
-        const double a = ray.Direction().LengthSquared();
-        const double h = Dot(ray.Direction(), OC);
-        const double c = OC.LengthSquared() - radius * radius;
-
-        const double discriminant = h * h - a * c;
-        if (discriminant < 0)
+        real root;
+        if (NearestRoot(ray, ray_t, center.At(ray.Time()), root) == false)
         {
             return false;
         }
 
-        const double sqrt_discriminant = std::sqrt(discriminant);
+        intersection.Set(root, this);
 
-        // Find the nearest root that lies in the acceptable range.
-        double root = (h - sqrt_discriminant) / a;
-        if (ray_t.Surrounds(root) == false)
-        {
-            root = (h + sqrt_discriminant) / a;
-            if (ray_t.Surrounds(root) == false)
-            {
-                return false;
-            }
-        }
+        return true;
+    }
 
-        hit_record.t = root;
+    void SetHitRecord(const Ray& ray, const Intersection& intersection, HitRecord& hit_record) const override
+    {
+        const Point3 current_center = center.At(ray.Time());
 
         hit_record.point = ray.At(hit_record.t);
 
@@ -392,9 +799,13 @@ public:
 
         GetUV(outward_normal, hit_record.u, hit_record.v);
 
-        hit_record.material = this->material;
+        hit_record.material = this->material.get();
+    }
 
-        return true;
+    bool Occluded(const Ray& ray, const Interval ray_t) const override
+    {
+        real root;
+        return NearestRoot(ray, ray_t, center.At(ray.Time()), root);
     }
 
     AABB BBox() const override
@@ -402,15 +813,117 @@ public:
         return this->bbox;
     }
 
+    bool IsEmissive() const override
+    {
+        return this->material->IsEmissive();
+    }
+
+    // Samples the cone of directions the sphere covers as seen from `origin`,
+    // and takes the point where the sampled direction meets the sphere. Moving
+    // spheres are sampled where they are at time 0.
+    real PdfValue(const Ray& ray, const Interval ray_t) const override
+    {
+        real root;
+        if (NearestRoot(ray, ray_t, this->center.At(0), root) == false)
+        {
+            return 0;
+        }
+
+        return this->ConePdf(ray.Origin());
+    }
+
+    LightSample Random(const Point3& origin) const override
+    {
+        const Point3 current_center = this->center.At(0);
+        const Vec3 to_center = current_center - origin;
+        const real distance_squared = to_center.LengthSquared();
+
+        Vec3 direction;
+        if (distance_squared <= this->radius * this->radius)
+        {
+            direction = RandomUnitVector();
+        }
+        else
+        {
+            const Onb uvw(to_center);
+            direction = uvw.Transform(RandomToSphere(this->radius, distance_squared));
+        }
+
+        LightSample sample;
+
+        // Directions on the very rim of the cone can miss by rounding.
+        real root;
+        if (NearestRoot(Ray(origin, direction), Interval(0, infinity), current_center, root) == false)
+        {
+            return sample;
+        }
+
+        sample.point = origin + root * direction;
+        sample.normal = (sample.point - current_center) / this->radius;
+
+        real u, v;
+        GetUV(sample.normal, u, v);
+        sample.emitted = this->material->Emit(u, v, sample.point);
+        sample.pdf = this->ConePdf(origin);
+
+        return sample;
+    }
+
 private:
     shared_ptr<Material> material;
     AABB bbox;
 
 
     Ray center;
-    double radius = 1;
+    real radius = 1;
 
-    static void GetUV(const Point3& p, double& u, double& v)
+    // Density of the directions `Random()` picks from `origin`.
+    real ConePdf(const Point3& origin) const
+    {
+        const real distance_squared = (this->center.At(0) - origin).LengthSquared();
+        if (distance_squared <= this->radius * this->radius)
+        {
+            // From the inside the sphere covers every direction.
+            return 1 / (4 * pi);
+        }
+
+        const real cos_theta_max = std::sqrt(1 - this->radius * this->radius / distance_squared);
+        const real solid_angle = 2 * pi * (1 - cos_theta_max);
+
+        return 1 / solid_angle;
+    }
+
+    bool NearestRoot(const Ray& ray, const Interval ray_t, const Point3& current_center, real& root) const
+    {
+        const Vec3 OC = current_center - ray.Origin();
+
+        const real a = ray.Direction().LengthSquared();
+        const real h = Dot(ray.Direction(), OC);
+        const real c = OC.LengthSquared() - radius * radius;
+
+        const real discriminant = h * h - a * c;
+        if (discriminant < 0)
+        {
+            return false;
+        }
+
+        const real sqrt_discriminant = std::sqrt(discriminant);
+
+        // Find the nearest root that lies in the acceptable range.
+        root = (h - sqrt_discriminant) / a;
+        if (ray_t.Surrounds(root) == false)
+        {
+            root = (h + sqrt_discriminant) / a;
+            if (ray_t.Surrounds(root) == false)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    static void GetUV(const Point3& p, real& u, real& v)
     {
         // p: a given point on the sphere of radius one, centered at the origin.
         // u: returned value [0, 1] of angle around the Y axis from X = -1.
@@ -419,12 +932,27 @@ private:
         //     <0 1 0> yields <0.50 1.00>       < 0 -1  0> yields <0.50 0.00>
         //     <0 0 1> yields <0.25 0.50>       < 0  0 -1> yields <0.75 0.50>
 
-        const double theta = std::acos(-p.y());
-        const double phi = std::atan2(-p.z(), p.x()) + pi;
+        const real theta = std::acos(-p.y());
+        const real phi = std::atan2(-p.z(), p.x()) + pi;
 
         u = phi / (2 * pi);
         v = theta / pi;
     }
+
+    // Uniform direction inside the cone around +Z that a sphere of `radius` at
+    // squared distance `distance_squared` covers.
+    static Vec3 RandomToSphere(const real radius, const real distance_squared)
+    {
+        const real r1 = RandomReal();
+        const real r2 = RandomReal();
+        const real z = 1 + r2 * (std::sqrt(1 - radius * radius / distance_squared) - 1);
+
+        const real phi = 2 * pi * r1;
+        const real x = std::cos(phi) * std::sqrt(1 - z * z);
+        const real y = std::sin(phi) * std::sqrt(1 - z * z);
+
+        return Vec3(x, y, z);
+    }
 };
 
 class Hit_Quad : public Hittable
@@ -437,6 +965,7 @@ public:
         this->normal = UnitVector(n);
         this->d = Dot(normal, q);
         this->w = n / Dot(n, n);
+        this->area = n.Length();
 
         SetBBox();
     }
@@ -451,37 +980,68 @@ public:
         return this->bbox;
     }
 
-    bool Hit(const Ray& ray, const Interval ray_t, HitRecord& hit_record) const override
+    bool Intersect(const Ray& ray, const Interval ray_t, Intersection& intersection) const override
     {
-        const double denominator = Dot(this->normal, ray.Direction());
-        if (std::abs(denominator) < 1e-8)
-            // Ray is parallel to plane.
+        real t, alpha, beta;
+        if (PlaneHit(ray, ray_t, t, alpha, beta) == false)
         {
             return false;
         }
 
-        const double t = (this->d - Dot(this->normal, ray.Origin())) / denominator;
-        if (ray_t.Contains(t) == false)
+        if (IsInterior(alpha, beta) == false)
         {
             return false;
         }
-        
-        const Point3 intersection = ray.At(t);
-        const Vec3 planar_intersection = intersection - this->q;
-        const double alpha = Dot(this->w, Cross(planar_intersection, v));
-        const double beta  = Dot(this->w, Cross(u, planar_intersection));
 
-        if (_Hit(alpha, beta, hit_record, intersection) == false)
+        intersection.Set(t, this, 0, alpha, beta);
+
+        return true;
+    }
+
+    void SetHitRecord(const Ray& ray, const Intersection& intersection, HitRecord& hit_record) const override
+    {
+        // The plane coordinates are the UVs.
+        hit_record.point = ray.At(hit_record.t);
+        hit_record.u = intersection.b1;
+        hit_record.v = intersection.b2;
+        hit_record.material = material.get();
+        hit_record.SetFaceNormal(ray, this->normal);
+    }
+
+    bool Occluded(const Ray& ray, const Interval ray_t) const override
+    {
+        real t, alpha, beta;
+        if (PlaneHit(ray, ray_t, t, alpha, beta) == false)
         {
             return false;
         }
 
-        hit_record.t = t;
-        hit_record.point = intersection;
-        hit_record.material = material;
-        hit_record.SetFaceNormal(ray, this->normal);
+        return IsInterior(alpha, beta);
+    }
 
-        return true;
+    bool IsEmissive() const override
+    {
+        return this->material->IsEmissive();
+    }
+
+    // Samples the surface uniformly by area, converted to a density per solid
+    // angle as seen from `origin`.
+    real PdfValue(const Ray& ray, const Interval ray_t) const override
+    {
+        Intersection intersection;
+        if (this->Intersect(ray, ray_t, intersection) == false)
+        {
+            return 0;
+        }
+
+        return SolidAngleDensity(intersection.t * ray.Direction(), this->normal, this->area);
+    }
+
+    LightSample Random(const Point3& origin) const override
+    {
+        const real alpha = RandomReal();
+        const real beta = RandomReal();
+        return this->LightSampleAt(origin, this->q + (alpha * this->u) + (beta * this->v), alpha, beta);
     }
 
 protected:
@@ -491,32 +1051,68 @@ protected:
     Point3 q;
     Vec3 u, v;
     Vec3 normal;
-    double d;
+    real d;
     Vec3 w;
+    real area;
 
-    virtual bool _Hit(const double alpha, const double beta, HitRecord& hit_record, const Point3& intersection) const
+    // Light sample at `point` on the surface, which has the UVs `(u, v)` there.
+    LightSample LightSampleAt(const Point3& origin, const Point3& point, const real u, const real v) const
     {
-        const Interval unit_interval = Interval(0, 1);
-        if (unit_interval.Contains(alpha) == false || unit_interval.Contains(beta) == false)
+        LightSample sample;
+        sample.point = point;
+        sample.normal = this->normal;
+        sample.emitted = this->material->Emit(u, v, point);
+        sample.pdf = SolidAngleDensity(point - origin, this->normal, this->area);
+        return sample;
+    }
+
+    // Intersects the plane of the quad, `alpha` and `beta` are the hit point in
+    // the plane's (u, v) coordinates.
+    bool PlaneHit(const Ray& ray, const Interval ray_t, real& t, real& alpha, real& beta) const
+    {
+        const real denominator = Dot(this->normal, ray.Direction());
+        if (std::abs(denominator) < parallel_epsilon)
+            // Ray is parallel to plane.
+        {
+            return false;
+        }
+
+        t = (this->d - Dot(this->normal, ray.Origin())) / denominator;
+        if (ray_t.Contains(t) == false)
         {
             return false;
         }
-        hit_record.u = alpha;
-        hit_record.v = beta;
+
+        const Vec3 planar_intersection = ray.At(t) - this->q;
+        alpha = Dot(this->w, Cross(planar_intersection, v));
+        beta  = Dot(this->w, Cross(u, planar_intersection));
+
         return true;
     }
+
+    // Whether the plane coordinates `(alpha, beta)` lie on the quad.
+    static bool IsInterior(const real alpha, const real beta)
+    {
+        const Interval unit_interval = Interval(0, 1);
+        return unit_interval.Contains(alpha) && unit_interval.Contains(beta);
+    }
 };
 
 class Hit_Tri : public Hit_Quad
 {
 public:
     Hit_Tri(const Point3& q, const Vec3& u, const Vec3& v, shared_ptr<Material> material) :
-        Hit_Quad(q, u, v, material) {}
+        Hit_Quad(q, u, v, material)
+    {
+        this->area /= 2;
+    }
 
     Hit_Tri(const Point3& q, const Vec3& u, const Vec3& v,
         const std::vector<Vec2>& uv,
         shared_ptr<Material> material) :
-        Hit_Quad(q, u, v, material), uv(uv) {
+        Hit_Quad(q, u, v, material), uv(uv)
+    {
+        this->area /= 2;
     }
 
     // uv[0] - Q
@@ -524,39 +1120,54 @@ public:
     // uv[2] - Q + v
     std::vector<Vec2> uv = std::vector<Vec2>(3);
 
-protected:
-    bool _Hit(const double alpha, const double beta, HitRecord& hit_record, const Point3& intersection) const override
+    bool Intersect(const Ray& ray, const Interval ray_t, Intersection& intersection) const override
     {
-        if (alpha < 0 || beta < 0 || alpha + beta > 1)
+        // Triangles skip the plane intersection of `Hit_Quad` and solve for the
+        // distance and barycentrics directly. The barycentrics then double as
+        // the UV interpolation weights.
+        real t, b1, b2;
+        if (IntersectTriangle(ray, ray_t, this->q, this->u, this->v, t, b1, b2) == false)
         {
             return false;
         }
 
-        const Vec3 b = this->q + this->u;
-        const Vec3 c = this->q + this->v;
-
-        const Vec3 v0 = b - this->q;
-        const Vec3 v1 = c - this->q;
-        const Vec3 v2 = intersection - this->q;
-
-        const double d00 = Dot(v0, v0);
-        const double d01 = Dot(v0, v1);
-        const double d11 = Dot(v1, v1);
-        const double d20 = Dot(v2, v0);
-        const double d21 = Dot(v2, v1);
+        intersection.Set(t, this, 0, b1, b2);
 
-        const double denom = d00 * d11 - d01 * d01;
-
-        const double v = (d11 * d20 - d01 * d21) / denom;
-        const double w = (d00 * d21 - d01 * d20) / denom;
-        const double u = 1 - v - w;
+        return true;
+    }
 
-        const Vec2 uv_p = u * uv[0] + v * uv[1] + w * uv[2];
+    void SetHitRecord(const Ray& ray, const Intersection& intersection, HitRecord& hit_record) const override
+    {
+        const real b1 = intersection.b1;
+        const real b2 = intersection.b2;
+        const Vec2 uv_p = (1 - b1 - b2) * uv[0] + b1 * uv[1] + b2 * uv[2];
 
+        hit_record.point = ray.At(hit_record.t);
+        hit_record.material = material.get();
+        hit_record.SetFaceNormal(ray, this->normal);
         hit_record.u = uv_p.x();
         hit_record.v = uv_p.y();
+    }
 
-        return true;
+    bool Occluded(const Ray& ray, const Interval ray_t) const override
+    {
+        real t, b1, b2;
+        return IntersectTriangle(ray, ray_t, this->q, this->u, this->v, t, b1, b2);
+    }
+
+    LightSample Random(const Point3& origin) const override
+    {
+        // Fold the unit square onto the triangle, so points stay uniform.
+        real b1 = RandomReal();
+        real b2 = RandomReal();
+        if (b1 + b2 > 1)
+        {
+            b1 = 1 - b1;
+            b2 = 1 - b2;
+        }
+
+        const Vec2 uv_p = (1 - b1 - b2) * uv[0] + b1 * uv[1] + b2 * uv[2];
+        return this->LightSampleAt(origin, this->q + (b1 * this->u) + (b2 * this->v), uv_p.x(), uv_p.y());
     }
 };
 
@@ -24,28 +24,43 @@ public:
     int width = 0;
     int height = 0;
 
-    Image(const int width, const int height) : width(width), height(height), data(width * height * 3) {}
+    Image(const int width, const int height) :
+        width(width), height(height), bytes_per_scanline(width * 3), data(size_t(width) * height * 3) {}
 
-    Image(const std::string& filename)
+    // Pixels hold linear values, as textures are sampled without conversion. If
+    // the file can't be decoded the image stays empty and `error` says why.
+    Image(const std::string& filename, std::string& error)
     {
         int n = this->bytes_per_pixel;
-        this->fdata = stbi_loadf(filename.c_str(), &this->width, &this->height, &n, this->bytes_per_pixel);
-        if (this->fdata == nullptr)
+
+        // Only HDR files need the float path, everything else is decoded to
+        // bytes directly.
+        if (stbi_is_hdr(filename.c_str()))
         {
-            std::cerr << "[ERROR]:\tCould not load image `" << filename << "'\n";
-            exit(1);
+            float* fdata = stbi_loadf(filename.c_str(), &this->width, &this->height, &n, this->bytes_per_pixel);
+            if (fdata == nullptr)
+            {
+                this->SetLoadError(filename, error);
+                return;
+            }
+
+            ConvertToBytes(fdata);
+            stbi_image_free(fdata);
         }
-
-        this->bytes_per_scanline = this->width * this->bytes_per_pixel;
-        ConvertToBytes();
-    }
-
-    ~Image()
-    {
-        if (this->fdata != nullptr)
+        else
         {
-            stbi_image_free(this->fdata);
+            uint8_t* bytes = stbi_load(filename.c_str(), &this->width, &this->height, &n, this->bytes_per_pixel);
+            if (bytes == nullptr)
+            {
+                this->SetLoadError(filename, error);
+                return;
+            }
+
+            LinearizeBytes(bytes);
+            stbi_image_free(bytes);
         }
+
+        this->bytes_per_scanline = this->width * this->bytes_per_pixel;
     }
 
     const uint8_t* PixelData(const int x, const int y) const
@@ -56,7 +71,12 @@ public:
             return magenta;
         }
 
-        return &data.data()[Clamp(y, 0, width) * bytes_per_scanline + Clamp(x, 0, height) * bytes_per_pixel];
+        return &data.data()[Clamp(y, 0, height) * bytes_per_scanline + Clamp(x, 0, width) * bytes_per_pixel];
+    }
+
+    int BytesPerScanline() const
+    {
+        return this->bytes_per_scanline;
     }
 
     void WriteColor(const int x, const int y, const Color& color)
@@ -77,7 +97,7 @@ public:
         this->data[offset_size_t + 2] = uint8_t(intensity.Clamp(b) * 255.999);
     }
 
-    int WritePNG(const std::string filename)
+    int WritePNG(const std::string filename) const
     {
         return stbi_write_png(
             filename.data(),
@@ -93,9 +113,19 @@ private:
     int bytes_per_pixel    = 3;
     int bytes_per_scanline = 0;
 
-    float*               fdata = nullptr;
     std::vector<uint8_t> data;
 
+    // The reason stb_image keeps per thread, so images can fail to decode on
+    // several threads at once.
+    void SetLoadError(const std::string& filename, std::string& error)
+    {
+        const char* reason = stbi_failure_reason();
+        error = "Could not load image `" + filename + "'" + (reason == nullptr ? "" : std::string(" (") + reason + ")");
+
+        this->width = 0;
+        this->height = 0;
+    }
+
     inline static int Clamp(const int x, const int low, const int high)
     {
         if (x < low) return low;
@@ -116,16 +146,34 @@ private:
         return uint8_t(256.0f * value);
     }
 
-    void ConvertToBytes()
+    void ConvertToBytes(const float* fdata)
     {
         const size_t total_bytes = size_t(this->width) * this->height * this->bytes_per_pixel;
         this->data.resize(total_bytes);
 
-        float* fdata_ptr = fdata;
+        for (size_t i = 0; i < total_bytes; ++i)
+        {
+            this->data[i] = FloatToByte(fdata[i]);
+        }
+    }
+
+    // Gives the same bytes as `stbi_loadf()` and `ConvertToBytes()`, which turn
+    // 8-bit files into linear floats with a 2.2 gamma first, through a table of
+    // the 256 possible values.
+    void LinearizeBytes(const uint8_t* bytes)
+    {
+        uint8_t table[256];
+        for (int value = 0; value < 256; ++value)
+        {
+            table[value] = FloatToByte(float(std::pow(double(float(value) / 255.0f), double(2.2f))));
+        }
+
+        const size_t total_bytes = size_t(this->width) * this->height * this->bytes_per_pixel;
+        this->data.resize(total_bytes);
 
-        for (size_t i = 0; i < total_bytes; ++i, ++fdata_ptr)
+        for (size_t i = 0; i < total_bytes; ++i)
         {
-            this->data[i] = FloatToByte(*fdata_ptr);
+            this->data[i] = table[bytes[i]];
         }
     }
 
@@ -2,16 +2,17 @@
 
 #include "RTWeekend.hpp"
 
+#include <algorithm>
 #include <utility>
 
 class Interval
 {
 public:
-    double min, max;
+    real min, max;
 
     Interval() : min(+infinity), max(-infinity) {}
 
-    Interval(const double min, const double max) : min(min), max(max) {}
+    Interval(const real min, const real max) : min(min), max(max) {}
 
     Interval(const Interval& a, const Interval& b)
     {
@@ -19,31 +20,31 @@ public:
         this->max = std::max(a.max, b.max);
     }
 
-    double Size() const
+    real Size() const
     {
         return this->max - this->min;
     }
 
-    bool Contains(const double x) const
+    bool Contains(const real x) const
     {
         return this->min <= x && x <= this->max;
     }
 
-    bool Surrounds(const double x) const
+    bool Surrounds(const real x) const
     {
         return this->min < x && x < this->max;
     }
 
-    double Clamp(const double x) const
+    real Clamp(const real x) const
     {
         if (x < this->min) return min;
         if (x > this->max) return max;
         return x;
     }
 
-    Interval Expand(const double delta) const
+    Interval Expand(const real delta) const
     {
-        const double padding = delta / 2;
+        const real padding = delta / 2;
         return Interval(this->min - padding, this->max + padding);
     }
 
@@ -53,12 +54,12 @@ public:
 const Interval Interval::Empty    = Interval(+infinity, -infinity);
 const Interval Interval::Universe = Interval(-infinity, +infinity);
 
-Interval operator+(const Interval& ival, const double displacement)
+Interval operator+(const Interval& ival, const real displacement)
 {
     return Interval(ival.min + displacement, ival.max + displacement);
 }
 
-Interval operator+(const double displacement, const Interval& ival)
+Interval operator+(const real displacement, const Interval& ival)
 {
     return ival + displacement;
 }
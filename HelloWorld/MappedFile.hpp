@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only view of a whole file mapped into memory. Pages are read in by the
+// OS on first touch, so several threads can work on different parts of a large
+// file without it ever being copied into a buffer.
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string& filename)
+    {
+#ifdef _WIN32
+        this->file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (this->file == INVALID_HANDLE_VALUE)
+        {
+            return;
+        }
+
+        LARGE_INTEGER file_size;
+        if (GetFileSizeEx(this->file, &file_size) == FALSE)
+        {
+            return;
+        }
+
+        if (file_size.QuadPart == 0)
+        {
+            // Empty files cannot be mapped, but are still valid.
+            this->is_open = true;
+            return;
+        }
+
+        this->mapping = CreateFileMappingA(this->file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (this->mapping == nullptr)
+        {
+            return;
+        }
+
+        this->data = static_cast<const char*>(MapViewOfFile(this->mapping, FILE_MAP_READ, 0, 0, 0));
+        this->size = size_t(file_size.QuadPart);
+        this->is_open = this->data != nullptr;
+#else
+        const int descriptor = open(filename.c_str(), O_RDONLY);
+        if (descriptor < 0)
+        {
+            return;
+        }
+
+        struct stat status;
+        if (fstat(descriptor, &status) == 0)
+        {
+            if (status.st_size == 0)
+            {
+                this->is_open = true;
+            }
+            else
+            {
+                void* view = mmap(nullptr, size_t(status.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0);
+                if (view != MAP_FAILED)
+                {
+                    madvise(view, size_t(status.st_size), MADV_WILLNEED);
+
+                    this->data = static_cast<const char*>(view);
+                    this->size = size_t(status.st_size);
+                    this->is_open = true;
+                }
+            }
+        }
+
+        // The mapping stays valid after the descriptor is closed.
+        close(descriptor);
+#endif
+    }
+
+    ~MappedFile()
+    {
+#ifdef _WIN32
+        if (this->data != nullptr)
+        {
+            UnmapViewOfFile(this->data);
+        }
+        if (this->mapping != nullptr)
+        {
+            CloseHandle(this->mapping);
+        }
+        if (this->file != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(this->file);
+        }
+#else
+        if (this->data != nullptr)
+        {
+            munmap(const_cast<char*>(this->data), this->size);
+        }
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool IsOpen() const
+    {
+        return this->is_open;
+    }
+
+    const char* Data() const
+    {
+        return this->data;
+    }
+
+    size_t Size() const
+    {
+        return this->size;
+    }
+
+private:
+    const char* data = nullptr;
+    size_t size = 0;
+    bool is_open = false;
+
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+};
@@ -3,11 +3,13 @@
 #include "RTWeekend.hpp"
 
 #include "Color.hpp"
-#include "Hittable.hpp"
+#include "HitRecord.hpp"
+#include "Onb.hpp"
 #include "Ray.hpp"
 #include "Texture.hpp"
 #include "Vec3.hpp"
 
+#include <algorithm>
 #include <cmath>
 #include <memory>
 #include <utility>
@@ -15,20 +17,56 @@
 using std::make_shared;
 using std::shared_ptr;
 
+// A direction drawn by `Material::Sample()`.
+class ScatterRecord
+{
+public:
+    Vec3 direction;
+
+    // What the path throughput gets multiplied by, `Eval() / pdf` for materials
+    // with a density.
+    Color weight;
+
+    // Density (per solid angle) `direction` was drawn with. 0 if the material only
+    // scatters into a single direction (mirrors, glass).
+    real pdf = 0;
+};
+
 class Material
 {
 public:
     virtual ~Material() = default;
 
-    virtual bool Scatter(const Ray& ray_in, const HitRecord& hit_record, Color& attenuation, Ray& scattered) const
+    // Draws the direction the ray continues in. Returns false if it is absorbed.
+    virtual bool Sample(const Ray& ray_in, const HitRecord& hit_record, ScatterRecord& scatter) const
     {
         return false;
     }
 
-    virtual Color Emit(const double u, const double v, const Point3& p) const
+    // Density (per solid angle) of `Sample()` drawing `direction`. Materials that
+    // only scatter into a single direction return 0, which also means light
+    // sampling can't help them.
+    virtual real Pdf(const Ray& ray_in, const HitRecord& hit_record, const Vec3& direction) const
+    {
+        return 0;
+    }
+
+    // Scattering function times the cosine term: the fraction of the light coming
+    // in from `direction` that leaves back along `ray_in`.
+    virtual Color Eval(const Ray& ray_in, const HitRecord& hit_record, const Vec3& direction) const
     {
         return Color(0, 0, 0);
     }
+
+    virtual Color Emit(const real u, const real v, const Point3& p) const
+    {
+        return Color(0, 0, 0);
+    }
+
+    virtual bool IsEmissive() const
+    {
+        return false;
+    }
 };
 
 class Mat_Lambertian : public Material
@@ -38,89 +76,144 @@ public:
 
     Mat_Lambertian(const shared_ptr<Texture> texture) : texture(texture) {}
 
-    bool Scatter(const Ray& ray_in, const HitRecord& hit_record, Color& attenuation, Ray& scattered) const override
+    bool Sample(const Ray& ray_in, const HitRecord& hit_record, ScatterRecord& scatter) const override
     {
-        Vec3 scatter_direction = hit_record.normal + RandomUnitVector();
-        if (scatter_direction.NearZero())
-        {
-            scatter_direction = hit_record.normal;
-        }
+        // Cosine-weighted, so the cosine and the 1/pi of the BRDF cancel with the
+        // density and only the albedo is left.
+        const Vec3 local = RandomCosineDirection();
 
-        scattered = Ray(hit_record.point, scatter_direction, ray_in.Time());
-        attenuation = texture->Value(hit_record.u, hit_record.v, hit_record.point);
+        scatter.direction = Onb(hit_record.normal).Transform(local);
+        scatter.weight = texture->Value(hit_record.u, hit_record.v, hit_record.point);
+        scatter.pdf = local.z() / pi;
 
         return true;
     }
 
+    real Pdf(const Ray& ray_in, const HitRecord& hit_record, const Vec3& direction) const override
+    {
+        const real cos_theta = Dot(hit_record.normal, UnitVector(direction));
+        return cos_theta < 0 ? 0 : cos_theta / pi;
+    }
+
+    Color Eval(const Ray& ray_in, const HitRecord& hit_record, const Vec3& direction) const override
+    {
+        return texture->Value(hit_record.u, hit_record.v, hit_record.point) * Pdf(ray_in, hit_record, direction);
+    }
+
 private:
     shared_ptr<Texture> texture;
 };
 
+// Fuzzy reflections use a Phong lobe around the mirror direction, whose exponent
+// gives about the same spread as offsetting the reflection by `fuzz` times a
+// random unit vector. Directions below the surface are absorbed.
 class Mat_Metal : public Material
 {
 public:
-    Mat_Metal(const Color& albedo, const double fuzz) : albedo(albedo), fuzz(fuzz) {}
+    Mat_Metal(const Color& albedo, const real fuzz) :
+        albedo(albedo), fuzz(fuzz), exponent(fuzz > 0 ? std::max(3 / (fuzz * fuzz), real(1)) : 0)
+    {
+    }
+
+    bool Sample(const Ray& ray_in, const HitRecord& hit_record, ScatterRecord& scatter) const override
+    {
+        const Vec3 reflected = UnitVector(Reflect(ray_in.Direction(), hit_record.normal));
+
+        if (this->fuzz > 0)
+        {
+            const real cos_alpha = std::pow(RandomReal(), 1 / (this->exponent + 1));
+            const real sin_alpha = std::sqrt(std::max(real(0), 1 - cos_alpha * cos_alpha));
+            const real phi = 2 * pi * RandomReal();
+
+            scatter.direction = Onb(reflected).Transform(Vec3(std::cos(phi) * sin_alpha, std::sin(phi) * sin_alpha, cos_alpha));
+            scatter.pdf = LobePdf(cos_alpha);
+        }
+        else
+        {
+            scatter.direction = reflected;
+            scatter.pdf = 0;
+        }
 
-    bool Scatter(const Ray& ray_in, const HitRecord& hit_record, Color& attenuation, Ray& scattered) const override
+        scatter.weight = this->albedo;
+
+        return (Dot(scatter.direction, hit_record.normal) > 0);
+    }
+
+    real Pdf(const Ray& ray_in, const HitRecord& hit_record, const Vec3& direction) const override
     {
-        Vec3 reflected = Reflect(ray_in.Direction(), hit_record.normal);
-        reflected = UnitVector(reflected) + (fuzz * RandomUnitVector());
+        if (this->fuzz <= 0)
+        {
+            return 0;
+        }
 
-        scattered = Ray(hit_record.point, reflected, ray_in.Time());
-        attenuation = albedo;
+        const Vec3 unit_direction = UnitVector(direction);
+        if (Dot(unit_direction, hit_record.normal) <= 0)
+        {
+            return 0;
+        }
+
+        const Vec3 reflected = UnitVector(Reflect(ray_in.Direction(), hit_record.normal));
+        return LobePdf(std::max(Dot(unit_direction, reflected), real(0)));
+    }
 
-        return (Dot(scattered.Direction(), hit_record.normal) > 0);
+    Color Eval(const Ray& ray_in, const HitRecord& hit_record, const Vec3& direction) const override
+    {
+        return this->albedo * Pdf(ray_in, hit_record, direction);
     }
 
 private:
     Color albedo;
-    double fuzz = 0;
+    real fuzz = 0;
+    real exponent = 0;
+
+    real LobePdf(const real cos_alpha) const
+    {
+        return (this->exponent + 1) / (2 * pi) * std::pow(cos_alpha, this->exponent);
+    }
 };
 
 class Mat_Dielectric : public Material
 {
 public:
-    Mat_Dielectric(const double refraction_index) : refraction_index(refraction_index) {}
+    Mat_Dielectric(const real refraction_index) : refraction_index(refraction_index) {}
 
-    bool Scatter(const Ray& ray_in, const HitRecord& hit_record, Color& attenuation, Ray& scattered) const override
+    bool Sample(const Ray& ray_in, const HitRecord& hit_record, ScatterRecord& scatter) const override
     {
         // Attenuation is always 1 — the glass surface absorbs nothing.
-        attenuation = Color(1, 1, 1);
+        scatter.weight = Color(1, 1, 1);
+        scatter.pdf = 0;
 
-        const double ri = hit_record.front_face ? (1.0 / this->refraction_index) : this->refraction_index;
+        const real ri = hit_record.front_face ? (1 / this->refraction_index) : this->refraction_index;
 
         const Vec3 unit_direction = UnitVector(ray_in.Direction());
 
-        const double cos_theta = std::min(Dot(-unit_direction, hit_record.normal), 1.0);
-        const double sin_theta = std::sqrt(1.0 - cos_theta * cos_theta);
+        const real cos_theta = std::min(Dot(-unit_direction, hit_record.normal), real(1));
+        const real sin_theta = std::sqrt(1 - cos_theta * cos_theta);
 
-        const bool cant_refract = (ri * sin_theta) > 1.0;
+        const bool cant_refract = (ri * sin_theta) > 1;
 
-        Vec3 direction;
-        if (cant_refract || Reflectance(cos_theta, ri) > RandomDouble())
+        if (cant_refract || Reflectance(cos_theta, ri) > RandomReal())
         {
-            direction = Reflect(unit_direction, hit_record.normal);
+            scatter.direction = Reflect(unit_direction, hit_record.normal);
         }
         else
         {
-            direction = Refract(unit_direction, hit_record.normal, ri);
+            scatter.direction = Refract(unit_direction, hit_record.normal, ri);
         }
 
-        scattered = Ray(hit_record.point, direction, ray_in.Time());
-
         return true;
     }
 
 private:
     // Refractive index in vacuum or air, or the ratio of the material's refractive index
     // over the refractive index of enclosing media.
-    double refraction_index;
+    real refraction_index;
 
-    static double Reflectance(const double cosine, const double refraction_index)
+    static real Reflectance(const real cosine, const real refraction_index)
     {
         // Use Schlik's approximation for reflectance.
-        const double r0 = std::pow((1 - refraction_index) / (1 + refraction_index), 2);
-        return r0 + (1 - r0) * std::pow((1 - cosine), 5);
+        const real r0 = std::pow((1 - refraction_index) / (1 + refraction_index), real(2));
+        return r0 + (1 - r0) * std::pow((1 - cosine), real(5));
     }
 };
 
@@ -130,11 +223,16 @@ public:
     Mat_DiffuseLight(shared_ptr<Texture> tex) : texture(tex) {}
     Mat_DiffuseLight(const Color& emit) : texture(make_shared<Tex_SolidColor>(emit)) {}
 
-    Color Emit(const double u, const double v, const Point3& p) const override
+    Color Emit(const real u, const real v, const Point3& p) const override
     {
         return texture->Value(u, v, p);
     }
 
+    bool IsEmissive() const override
+    {
+        return true;
+    }
+
 private:
     shared_ptr<Texture> texture;
 };
@@ -145,13 +243,24 @@ public:
     Mat_Isotropic(const Color& albedo) : tex(make_shared<Tex_SolidColor>(albedo)) {}
     Mat_Isotropic(shared_ptr<Texture> tex) : tex(tex) {}
 
-    bool Scatter(const Ray& ray_in, const HitRecord& hit_record, Color& attenuation, Ray& scattered) const override
+    bool Sample(const Ray& ray_in, const HitRecord& hit_record, ScatterRecord& scatter) const override
     {
-        scattered = Ray(hit_record.point, RandomUnitVector(), ray_in.Time());
-        attenuation = tex->Value(hit_record.u, hit_record.v, hit_record.point);
+        scatter.direction = RandomUnitVector();
+        scatter.weight = tex->Value(hit_record.u, hit_record.v, hit_record.point);
+        scatter.pdf = 1 / (4 * pi);
         return true;
     }
 
+    real Pdf(const Ray& ray_in, const HitRecord& hit_record, const Vec3& direction) const override
+    {
+        return 1 / (4 * pi);
+    }
+
+    Color Eval(const Ray& ray_in, const HitRecord& hit_record, const Vec3& direction) const override
+    {
+        return tex->Value(hit_record.u, hit_record.v, hit_record.point) / (4 * pi);
+    }
+
 private:
     shared_ptr<Texture> tex;
 };
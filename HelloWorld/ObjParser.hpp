@@ -0,0 +1,749 @@
+#pragma once
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#define TINYOBJLOADER_USE_DOUBLE
+#include "include/tiny_obj_loader.h"
+
+#include "RTWeekend.hpp"
+
+#include "Hit_TriangleMesh.hpp"
+#include "MappedFile.hpp"
+#include "TaskPool.hpp"
+#include "Vec2.hpp"
+#include "Vec3.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <map>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Loads the geometry of Wavefront OBJ files straight into the buffers of a
+// `MeshData`. The file is memory-mapped and cut into chunks at line boundaries,
+// which are parsed in parallel in two passes: the first counts the elements of
+// every chunk, so the second knows where in the shared buffers each chunk writes
+// and what the relative indices of its faces refer to. Only the MTL libraries go
+// through tinyobj, they are small.
+class ObjParser
+{
+public:
+    // Fills `mesh` and `materials` from `filename` and the MTL libraries it
+    // names, whose paths go to `material_libraries`. `mesh.material_ids` index
+    // `materials`, faces without a material get `materials.size()`, and
+    // `mesh.materials` is left to the caller. Quads are
+    // split along their shorter diagonal like in tinyobj, larger polygons into
+    // triangle fans.
+    static bool Parse(const std::string& filename, MeshData& mesh, std::vector<tinyobj::material_t>& materials, std::vector<std::string>& material_libraries, std::string& warning, std::string& error)
+    {
+        const MappedFile file(filename);
+        if (file.IsOpen() == false)
+        {
+            error = "Cannot open file [" + filename + "]\n";
+            return false;
+        }
+
+        std::vector<Chunk> chunks = Split(file);
+
+        ForEachChunk(chunks, [](Chunk& chunk) { Count(chunk); });
+
+        // Where every chunk's elements go in the shared buffers.
+        size_t positions = 0, uvs = 0, normals = 0, triangles = 0;
+        for (Chunk& chunk : chunks)
+        {
+            chunk.position_base = positions;
+            chunk.uv_base = uvs;
+            chunk.normal_base = normals;
+            chunk.triangle_base = triangles;
+
+            positions += chunk.positions;
+            uvs += chunk.uvs;
+            normals += chunk.normals;
+            triangles += chunk.triangles;
+        }
+
+        if (std::max({ positions, uvs, normals }) > UINT32_MAX)
+        {
+            error = "Too many vertices in [" + filename + "]\n";
+            return false;
+        }
+
+        ResolveMaterials(filename, chunks, materials, material_libraries, warning);
+
+        Buffers buffers;
+        buffers.mesh = &mesh;
+        buffers.position_count = positions;
+        buffers.uv_count = uvs;
+        buffers.normal_count = normals;
+
+        mesh.positions.assign(positions, Point3());
+        mesh.uvs.assign(uvs, Vec2());
+        mesh.normals.assign(normals, Vec3());
+        mesh.indices.assign(3 * triangles, 0);
+        mesh.material_ids.assign(triangles, 0);
+        if (uvs > 0)
+        {
+            buffers.uv_indices.assign(3 * triangles, 0);
+        }
+        if (normals > 0)
+        {
+            buffers.normal_indices.assign(3 * triangles, 0);
+        }
+
+        ForEachChunk(chunks, [&buffers](Chunk& chunk) { Read(chunk, buffers); });
+
+        bool shares_indices = (uvs == 0 || uvs == positions) && (normals == 0 || normals == positions);
+        for (const Chunk& chunk : chunks)
+        {
+            if (chunk.error.empty() == false)
+            {
+                error = chunk.error + " in [" + filename + "]\n";
+                return false;
+            }
+
+            shares_indices = shares_indices && chunk.shares_indices;
+        }
+
+        ForEachChunk(chunks, [&buffers](Chunk& chunk) { SplitQuads(chunk, buffers); });
+
+        // Files that index all attributes of a corner alike are done: the file's
+        // arrays are the mesh's arrays. Others get a mesh vertex per distinct
+        // combination of the three.
+        if (shares_indices == false)
+        {
+            if (mesh.indices.size() > UINT32_MAX)
+            {
+                error = "Too many vertices in [" + filename + "]\n";
+                return false;
+            }
+
+            MergeVertices(buffers);
+        }
+
+        return true;
+    }
+
+private:
+    // Chunks smaller than this are not worth a thread.
+    static constexpr size_t min_chunk_size = size_t(1) << 20;
+
+    // Same for the face corners `MergeVertices()` goes through.
+    static constexpr size_t min_merge_chunk_size = size_t(1) << 16;
+
+    static constexpr uint32_t no_index = UINT32_MAX;
+
+    struct Chunk
+    {
+        const char* begin = nullptr;
+        const char* end = nullptr;
+
+        // Counted by the first pass.
+        size_t positions = 0, uvs = 0, normals = 0, triangles = 0;
+        std::vector<std::string> material_libraries;
+        std::vector<std::string> material_names;  // Of every `usemtl`, in order.
+
+        // Set between the passes.
+        size_t position_base = 0, uv_base = 0, normal_base = 0, triangle_base = 0;
+        std::vector<uint32_t> material_ids;       // Of every `usemtl`, in order.
+        uint32_t first_material_id = 0;           // Material in use where the chunk starts.
+
+        // Set by the second pass.
+        bool shares_indices = true;               // Every corner uses one index for all of its attributes.
+        std::vector<size_t> quads;                // First of the two triangles of every quad.
+        std::string error;
+    };
+
+    // Written by all chunks of the second pass, each into its own range.
+    struct Buffers
+    {
+        MeshData* mesh = nullptr;
+        size_t position_count = 0, uv_count = 0, normal_count = 0;
+
+        // Per corner, like `mesh->indices` holds the positions.
+        std::vector<uint32_t> uv_indices;
+        std::vector<uint32_t> normal_indices;
+    };
+
+    static std::vector<Chunk> Split(const MappedFile& file)
+    {
+        const char* data = file.Data();
+        const size_t size = file.Size();
+
+        const size_t thread_count = std::max(1u, std::thread::hardware_concurrency());
+        const size_t chunk_count = std::clamp(size / min_chunk_size, size_t(1), thread_count);
+
+        std::vector<Chunk> chunks(chunk_count);
+
+        const char* begin = data;
+        for (size_t i = 0; i < chunk_count; ++i)
+        {
+            const char* end = data + size;
+            if (i + 1 < chunk_count)
+            {
+                // Moved past the end of the line it falls into.
+                end = std::max(begin, data + size * (i + 1) / chunk_count);
+                const void* newline = std::memchr(end, '\n', size_t(data + size - end));
+                end = newline == nullptr ? data + size : static_cast<const char*>(newline) + 1;
+            }
+
+            chunks[i].begin = begin;
+            chunks[i].end = end;
+            begin = end;
+        }
+
+        return chunks;
+    }
+
+    // Runs `function` on every chunk, each on its own thread.
+    template <typename Function>
+    static void ForEachChunk(std::vector<Chunk>& chunks, Function&& function)
+    {
+        std::vector<std::future<void>> tasks;
+        for (size_t i = 1; i < chunks.size(); ++i)
+        {
+            tasks.push_back(std::async(std::launch::async, [&function, &chunks, i]()
+            {
+                function(chunks[i]);
+            }));
+        }
+
+        function(chunks[0]);
+
+        for (std::future<void>& task : tasks)
+        {
+            task.get();
+        }
+    }
+
+    // Calls `function(line_begin, line_end)` for every line, without the newline.
+    template <typename Function>
+    static void ForEachLine(const char* begin, const char* end, Function&& function)
+    {
+        while (begin < end)
+        {
+            const void* newline = std::memchr(begin, '\n', size_t(end - begin));
+            const char* line_end = newline == nullptr ? end : static_cast<const char*>(newline);
+
+            function(begin, line_end);
+            begin = line_end + 1;
+        }
+    }
+
+    static bool IsSpace(const char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    // The next whitespace-separated token of a line, empty at its end.
+    static std::string_view NextToken(const char*& p, const char* end)
+    {
+        while (p < end && IsSpace(*p))
+        {
+            ++p;
+        }
+
+        const char* begin = p;
+        while (p < end && IsSpace(*p) == false)
+        {
+            ++p;
+        }
+
+        return std::string_view(begin, size_t(p - begin));
+    }
+
+    // The rest of a line without surrounding whitespace, for names that may
+    // contain spaces.
+    static std::string_view Rest(const char* p, const char* end)
+    {
+        while (p < end && IsSpace(*p))
+        {
+            ++p;
+        }
+        while (end > p && IsSpace(end[-1]))
+        {
+            --end;
+        }
+
+        return std::string_view(p, size_t(end - p));
+    }
+
+    // Missing or malformed numbers read as 0, like in tinyobj.
+    static real ParseReal(const char*& p, const char* end)
+    {
+        const std::string_view token = NextToken(p, end);
+        const char* first = token.data();
+        const char* last = first + token.size();
+        if (first < last && *first == '+')
+        {
+            ++first;
+        }
+
+        real value = 0;
+        std::from_chars(first, last, value);
+        return value;
+    }
+
+    // First pass: counts what the chunk holds and collects the names it uses.
+    static void Count(Chunk& chunk)
+    {
+        ForEachLine(chunk.begin, chunk.end, [&chunk](const char* p, const char* end)
+        {
+            const std::string_view keyword = NextToken(p, end);
+
+            if (keyword == "v")
+            {
+                ++chunk.positions;
+            }
+            else if (keyword == "vt")
+            {
+                ++chunk.uvs;
+            }
+            else if (keyword == "vn")
+            {
+                ++chunk.normals;
+            }
+            else if (keyword == "f")
+            {
+                size_t corners = 0;
+                while (NextToken(p, end).empty() == false)
+                {
+                    ++corners;
+                }
+
+                if (corners >= 3)
+                {
+                    chunk.triangles += corners - 2;
+                }
+            }
+            else if (keyword == "usemtl")
+            {
+                chunk.material_names.emplace_back(Rest(p, end));
+            }
+            else if (keyword == "mtllib")
+            {
+                for (std::string_view library = NextToken(p, end); library.empty() == false; library = NextToken(p, end))
+                {
+                    chunk.material_libraries.emplace_back(library);
+                }
+            }
+        });
+    }
+
+    // Loads the MTL libraries the file names and turns the material names of
+    // every chunk into indices into `materials`.
+    static void ResolveMaterials(const std::string& filename, std::vector<Chunk>& chunks, std::vector<tinyobj::material_t>& materials, std::vector<std::string>& material_libraries, std::string& warning)
+    {
+        // MTL paths are relative to the directory of the OBJ file.
+        const size_t separator = filename.find_last_of("/\\");
+        const std::string directory = separator == std::string::npos ? "" : filename.substr(0, separator + 1);
+
+        std::map<std::string, int> material_map;
+
+        for (const Chunk& chunk : chunks)
+        {
+            for (const std::string& library : chunk.material_libraries)
+            {
+                const std::string path = directory + library;
+                if (std::find(material_libraries.begin(), material_libraries.end(), path) != material_libraries.end())
+                {
+                    continue;
+                }
+                material_libraries.push_back(path);
+
+                std::ifstream stream(path);
+                if (stream.is_open() == false)
+                {
+                    warning += "Material file [" + path + "] not found\n";
+                    continue;
+                }
+
+                std::string mtl_warning, mtl_error;
+                tinyobj::LoadMtl(&material_map, &materials, &stream, &mtl_warning, &mtl_error);
+                warning += mtl_warning + mtl_error;
+            }
+        }
+
+        const uint32_t no_material = (uint32_t)materials.size();
+
+        uint32_t material_id = no_material;
+        for (Chunk& chunk : chunks)
+        {
+            chunk.first_material_id = material_id;
+
+            for (const std::string& name : chunk.material_names)
+            {
+                const auto it = material_map.find(name);
+                if (it == material_map.end())
+                {
+                    warning += "Material [" + name + "] not found\n";
+                }
+
+                material_id = it == material_map.end() ? no_material : (uint32_t)it->second;
+                chunk.material_ids.push_back(material_id);
+            }
+        }
+    }
+
+    // OBJ indices count from 1, negative ones back from the last element read.
+    static bool ResolveIndex(const long long index, const size_t read_so_far, const size_t total, uint32_t& resolved)
+    {
+        const long long absolute = index > 0 ? index - 1 : (long long)read_so_far + index;
+        if (index == 0 || absolute < 0 || absolute >= (long long)total)
+        {
+            return false;
+        }
+
+        resolved = (uint32_t)absolute;
+        return true;
+    }
+
+    struct Corner
+    {
+        uint32_t position = no_index, uv = no_index, normal = no_index;
+    };
+
+    // Reads a face corner such as `1`, `1/2`, `1//3` or `1/2/3`.
+    static bool ParseCorner(const std::string_view token, const Chunk& chunk, const size_t positions, const size_t uvs, const size_t normals, const Buffers& buffers, Corner& corner)
+    {
+        const char* p = token.data();
+        const char* end = p + token.size();
+
+        long long indices[3] = { 0, 0, 0 };
+        for (int attribute = 0; attribute < 3 && p < end; ++attribute)
+        {
+            if (*p != '/')
+            {
+                const std::from_chars_result result = std::from_chars(p, end, indices[attribute]);
+                if (result.ec != std::errc() || indices[attribute] == 0)
+                {
+                    return false;
+                }
+                p = result.ptr;
+            }
+
+            if (p < end)
+            {
+                if (*p != '/')
+                {
+                    return false;
+                }
+                ++p;
+            }
+        }
+
+        return ResolveIndex(indices[0], chunk.position_base + positions, buffers.position_count, corner.position)
+            && (indices[1] == 0 || ResolveIndex(indices[1], chunk.uv_base + uvs, buffers.uv_count, corner.uv))
+            && (indices[2] == 0 || ResolveIndex(indices[2], chunk.normal_base + normals, buffers.normal_count, corner.normal));
+    }
+
+    // Second pass: writes the chunk's elements into its ranges of the buffers.
+    static void Read(Chunk& chunk, Buffers& buffers)
+    {
+        MeshData& mesh = *buffers.mesh;
+
+        size_t positions = 0, uvs = 0, normals = 0, triangles = 0, materials = 0;
+        uint32_t material_id = chunk.first_material_id;
+        std::vector<Corner> corners;
+
+        ForEachLine(chunk.begin, chunk.end, [&](const char* p, const char* end)
+        {
+            if (chunk.error.empty() == false)
+            {
+                return;
+            }
+
+            const std::string_view keyword = NextToken(p, end);
+
+            if (keyword == "v")
+            {
+                const real x = ParseReal(p, end);
+                const real y = ParseReal(p, end);
+                const real z = ParseReal(p, end);
+                mesh.positions[chunk.position_base + positions++] = Point3(x, y, z);
+            }
+            else if (keyword == "vt")
+            {
+                const real u = ParseReal(p, end);
+                const real v = ParseReal(p, end);
+                mesh.uvs[chunk.uv_base + uvs++] = Vec2(u, v);
+            }
+            else if (keyword == "vn")
+            {
+                const real x = ParseReal(p, end);
+                const real y = ParseReal(p, end);
+                const real z = ParseReal(p, end);
+                mesh.normals[chunk.normal_base + normals++] = Vec3(x, y, z);
+            }
+            else if (keyword == "f")
+            {
+                corners.clear();
+                for (std::string_view token = NextToken(p, end); token.empty() == false; token = NextToken(p, end))
+                {
+                    Corner corner;
+                    if (ParseCorner(token, chunk, positions, uvs, normals, buffers, corner) == false)
+                    {
+                        chunk.error = "Invalid face corner [" + std::string(token) + "]";
+                        return;
+                    }
+
+                    chunk.shares_indices = chunk.shares_indices
+                        && (buffers.uv_count == 0 || corner.uv == corner.position)
+                        && (buffers.normal_count == 0 || corner.normal == corner.position);
+
+                    corners.push_back(corner);
+                }
+
+                if (corners.size() == 4)
+                {
+                    chunk.quads.push_back(chunk.triangle_base + triangles);
+                }
+
+                for (size_t k = 1; k + 1 < corners.size(); ++k)
+                {
+                    const size_t triangle = chunk.triangle_base + triangles++;
+                    const Corner* fan[3] = { &corners[0], &corners[k], &corners[k + 1] };
+
+                    for (int c = 0; c < 3; ++c)
+                    {
+                        mesh.indices[3 * triangle + c] = fan[c]->position;
+                        if (buffers.uv_indices.empty() == false)
+                        {
+                            buffers.uv_indices[3 * triangle + c] = fan[c]->uv;
+                        }
+                        if (buffers.normal_indices.empty() == false)
+                        {
+                            buffers.normal_indices[3 * triangle + c] = fan[c]->normal;
+                        }
+                    }
+
+                    mesh.material_ids[triangle] = material_id;
+                }
+            }
+            else if (keyword == "usemtl")
+            {
+                material_id = chunk.material_ids[materials++];
+            }
+        });
+    }
+
+    // Quads are read as the fan (0, 1, 2), (0, 2, 3). Choosing the shorter
+    // diagonal needs positions that other chunks may still be writing during
+    // `Read()`, so it waits for a pass of its own.
+    static void SplitQuads(const Chunk& chunk, Buffers& buffers)
+    {
+        MeshData& mesh = *buffers.mesh;
+
+        for (const size_t triangle : chunk.quads)
+        {
+            const uint32_t* corners = &mesh.indices[3 * triangle];
+            const real diagonal_02 = (mesh.positions[corners[2]] - mesh.positions[corners[0]]).LengthSquared();
+            const real diagonal_13 = (mesh.positions[corners[5]] - mesh.positions[corners[1]]).LengthSquared();
+
+            if (diagonal_02 < diagonal_13)
+            {
+                continue;
+            }
+
+            UseOtherDiagonal(mesh.indices, triangle);
+            if (buffers.uv_indices.empty() == false)
+            {
+                UseOtherDiagonal(buffers.uv_indices, triangle);
+            }
+            if (buffers.normal_indices.empty() == false)
+            {
+                UseOtherDiagonal(buffers.normal_indices, triangle);
+            }
+        }
+    }
+
+    // Turns the quad (0, 1, 2), (0, 2, 3) into (0, 1, 3), (1, 2, 3).
+    static void UseOtherDiagonal(std::vector<uint32_t>& corners, const size_t triangle)
+    {
+        uint32_t* quad = &corners[3 * triangle];
+        const uint32_t c0 = quad[0], c1 = quad[1], c2 = quad[2], c3 = quad[5];
+
+        quad[0] = c0; quad[1] = c1; quad[2] = c3;
+        quad[3] = c1; quad[4] = c2; quad[5] = c3;
+    }
+
+    // Gives every distinct combination of position, texture coordinate and
+    // normal used by a corner its own mesh vertex. Corners without a texture
+    // coordinate or normal get zero ones. The corners are first grouped by
+    // position, with a counting sort, so every range of positions finds its
+    // combinations on its own thread. The vertices come out ordered by
+    // position, and each position's in the order the corners use them.
+    static void MergeVertices(Buffers& buffers)
+    {
+        MeshData& mesh = *buffers.mesh;
+
+        const size_t corner_count = mesh.indices.size();
+        const size_t position_count = mesh.positions.size();
+
+        const size_t thread_count = std::max(1u, std::thread::hardware_concurrency());
+        const size_t chunk_count = std::clamp(corner_count / min_merge_chunk_size, size_t(1), thread_count);
+        TaskPool pool((int)chunk_count);
+
+        const auto uv_index = [&buffers](const uint32_t corner)
+        {
+            return buffers.uv_indices.empty() ? no_index : buffers.uv_indices[corner];
+        };
+        const auto normal_index = [&buffers](const uint32_t corner)
+        {
+            return buffers.normal_indices.empty() ? no_index : buffers.normal_indices[corner];
+        };
+
+        // The corners of position `p` are `position_corners[first_corner[p]]` up to
+        // `first_corner[p + 1]`, sorted.
+        std::vector<uint32_t> first_corner(position_count + 1, 0);
+        pool.ForEachChunk(0, corner_count, chunk_count, [&](size_t, const size_t begin, const size_t end)
+        {
+            for (size_t corner = begin; corner < end; ++corner)
+            {
+                std::atomic_ref<uint32_t>(first_corner[mesh.indices[corner]]).fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+        ExclusiveScan(pool, chunk_count, first_corner);
+
+        std::vector<uint32_t> position_corners(corner_count);
+        {
+            std::vector<uint32_t> next_slot(first_corner.begin(), first_corner.end() - 1);
+            pool.ForEachChunk(0, corner_count, chunk_count, [&](size_t, const size_t begin, const size_t end)
+            {
+                for (size_t corner = begin; corner < end; ++corner)
+                {
+                    const uint32_t slot = std::atomic_ref<uint32_t>(next_slot[mesh.indices[corner]]).fetch_add(1, std::memory_order_relaxed);
+                    position_corners[slot] = uint32_t(corner);
+                }
+            });
+        }
+
+        // Which of its position's vertices every corner uses, and how many each
+        // position has, which the scan turns into where they start.
+        std::vector<uint32_t> corner_vertices(corner_count);
+        std::vector<uint32_t> first_vertex(position_count + 1, 0);
+        pool.ForEachChunk(0, position_count, chunk_count, [&](size_t, const size_t begin, const size_t end)
+        {
+            // First corner of every vertex of the position. There are rarely more
+            // than a few, so they are searched linearly.
+            std::vector<uint32_t> vertex_corners;
+
+            for (size_t position = begin; position < end; ++position)
+            {
+                uint32_t* const corners_begin = position_corners.data() + first_corner[position];
+                uint32_t* const corners_end = position_corners.data() + first_corner[position + 1];
+
+                // The scatter above filled them in any order.
+                std::sort(corners_begin, corners_end);
+
+                vertex_corners.clear();
+                for (const uint32_t* corner = corners_begin; corner < corners_end; ++corner)
+                {
+                    const uint32_t uv = uv_index(*corner);
+                    const uint32_t normal = normal_index(*corner);
+
+                    size_t vertex = 0;
+                    while (vertex < vertex_corners.size() &&
+                        (uv_index(vertex_corners[vertex]) != uv || normal_index(vertex_corners[vertex]) != normal))
+                    {
+                        ++vertex;
+                    }
+
+                    if (vertex == vertex_corners.size())
+                    {
+                        vertex_corners.push_back(*corner);
+                    }
+
+                    corner_vertices[*corner] = uint32_t(vertex);
+                }
+
+                first_vertex[position] = uint32_t(vertex_corners.size());
+            }
+        });
+        ExclusiveScan(pool, chunk_count, first_vertex);
+
+        // The final buffers, each vertex written by the first corner that uses it.
+        const size_t vertex_count = first_vertex[position_count];
+
+        std::vector<Point3> positions(vertex_count);
+        std::vector<Vec2> uvs(mesh.uvs.empty() ? 0 : vertex_count);
+        std::vector<Vec3> normals(mesh.normals.empty() ? 0 : vertex_count);
+
+        pool.ForEachChunk(0, position_count, chunk_count, [&](size_t, const size_t begin, const size_t end)
+        {
+            for (size_t position = begin; position < end; ++position)
+            {
+                uint32_t next_vertex = 0;
+
+                for (uint32_t slot = first_corner[position]; slot < first_corner[position + 1]; ++slot)
+                {
+                    const uint32_t corner = position_corners[slot];
+                    const uint32_t vertex = first_vertex[position] + corner_vertices[corner];
+
+                    if (corner_vertices[corner] == next_vertex)
+                    {
+                        ++next_vertex;
+
+                        positions[vertex] = mesh.positions[position];
+
+                        if (uvs.empty() == false)
+                        {
+                            const uint32_t uv = uv_index(corner);
+                            uvs[vertex] = uv == no_index ? Vec2(0, 0) : mesh.uvs[uv];
+                        }
+
+                        if (normals.empty() == false)
+                        {
+                            const uint32_t normal = normal_index(corner);
+                            normals[vertex] = normal == no_index ? Vec3(0, 0, 0) : mesh.normals[normal];
+                        }
+                    }
+
+                    mesh.indices[corner] = vertex;
+                }
+            }
+        });
+
+        mesh.positions = std::move(positions);
+        mesh.uvs = std::move(uvs);
+        mesh.normals = std::move(normals);
+    }
+
+    // Turns `values` into the sums of the values before each, in `chunk_count`
+    // parallel chunks: one pass sums every chunk, the other adds up within them.
+    static void ExclusiveScan(TaskPool& pool, const size_t chunk_count, std::vector<uint32_t>& values)
+    {
+        std::vector<uint32_t> chunk_sums(chunk_count + 1, 0);
+        pool.ForEachChunk(0, values.size(), chunk_count, [&](const size_t chunk, const size_t begin, const size_t end)
+        {
+            uint32_t sum = 0;
+            for (size_t i = begin; i < end; ++i)
+            {
+                sum += values[i];
+            }
+            chunk_sums[chunk + 1] = sum;
+        });
+
+        for (size_t chunk = 0; chunk < chunk_count; ++chunk)
+        {
+            chunk_sums[chunk + 1] += chunk_sums[chunk];
+        }
+
+        pool.ForEachChunk(0, values.size(), chunk_count, [&](const size_t chunk, const size_t begin, const size_t end)
+        {
+            uint32_t sum = chunk_sums[chunk];
+            for (size_t i = begin; i < end; ++i)
+            {
+                const uint32_t value = values[i];
+                values[i] = sum;
+                sum += value;
+            }
+        });
+    }
+};
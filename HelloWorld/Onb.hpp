@@ -0,0 +1,33 @@
+#pragma once
+
+#include "RTWeekend.hpp"
+
+#include "Vec3.hpp"
+
+#include <cmath>
+
+// Orthonormal basis around a given direction, which becomes the local Z axis.
+// Used to turn directions sampled around +Z into world space.
+class Onb
+{
+public:
+    Onb(const Vec3& n)
+    {
+        this->axis[2] = UnitVector(n);
+        const Vec3 a = (std::fabs(this->axis[2].x()) > real(0.9)) ? Vec3(0, 1, 0) : Vec3(1, 0, 0);
+        this->axis[1] = UnitVector(Cross(this->axis[2], a));
+        this->axis[0] = Cross(this->axis[2], this->axis[1]);
+    }
+
+    const Vec3& u() const { return this->axis[0]; }
+    const Vec3& v() const { return this->axis[1]; }
+    const Vec3& w() const { return this->axis[2]; }
+
+    Vec3 Transform(const Vec3& v) const
+    {
+        return (v[0] * this->axis[0]) + (v[1] * this->axis[1]) + (v[2] * this->axis[2]);
+    }
+
+private:
+    Vec3 axis[3];
+};
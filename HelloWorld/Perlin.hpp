@@ -21,16 +21,16 @@ public:
         GeneratePerm(perm_z);
     }
 
-    double Noise(const Point3& p) const
+    real Noise(const Point3& p) const
     {
         // Description: construct a 1x1 cube with points having
         //  values of Perlin(floor(p.x()), Perlin(floor(p.x() + 1)
         //  etc. for each component. Then map Point(p) to space
         //  inside this 1x1 cube and interpolate.
 
-        const double u = p.x() - std::floor(p.x());
-        const double v = p.y() - std::floor(p.y());
-        const double w = p.z() - std::floor(p.z());
+        const real u = p.x() - std::floor(p.x());
+        const real v = p.y() - std::floor(p.y());
+        const real w = p.z() - std::floor(p.z());
 
         const int i = int(std::floor(p.x()));
         const int j = int(std::floor(p.y()));
@@ -55,11 +55,11 @@ public:
         return PerlinInterpolation(c, u, v, w);
     }
 
-    double Turbulence(const Point3& p, const int depth) const
+    real Turbulence(const Point3& p, const int depth) const
     {
-        double result = 0;
+        real result = 0;
         Point3 p_temp = p;
-        double weight = 1;
+        real weight = 1;
 
         for (int i = 0; i < depth; ++i)
         {
@@ -98,13 +98,13 @@ private:
         }
     }
 
-    static double PerlinInterpolation(const Vec3 c[2][2][2], const double u, const double v, const double w)
+    static real PerlinInterpolation(const Vec3 c[2][2][2], const real u, const real v, const real w)
     {
-        const double uu = u * u * (3 - 2 * u);
-        const double vv = v * v * (3 - 2 * v);
-        const double ww = w * w * (3 - 2 * w);
+        const real uu = u * u * (3 - 2 * u);
+        const real vv = v * v * (3 - 2 * v);
+        const real ww = w * w * (3 - 2 * w);
 
-        double result = 0;
+        real result = 0;
 
         for (int i = 0; i < 2; ++i)
         {
@@ -1,31 +1,136 @@
 #pragma once
 
+#include <cstdint>
 #include <limits>
-#include <random>
+
+// Scalar type of the geometry and shading math. Define RT_USE_FLOAT for a single
+// precision renderer, the default double build is the reference to check it
+// against.
+#ifdef RT_USE_FLOAT
+using real = float;
+#else
+using real = double;
+#endif
 
 // Constants
 
-const double infinity = std::numeric_limits<double>::infinity();
-const double pi       = 3.1415926535897932385;
+const real infinity = std::numeric_limits<real>::infinity();
+const real pi       = real(3.1415926535897932385);
+
+// Tolerances that follow the precision of `real`:
+// - parallel_epsilon: how close to lying in a plane a ray may get before it
+//   counts as missing the plane.
+// - spawn_epsilon: how far a new ray starts off the surface it leaves, relative
+//   to the size of the coordinates there (see `HitRecord::SpawnRay()`).
+#ifdef RT_USE_FLOAT
+constexpr real parallel_epsilon = 1e-6f;
+constexpr real spawn_epsilon    = 1e-4f;
+#else
+constexpr real parallel_epsilon = 1e-8;
+constexpr real spawn_epsilon    = 1e-9;
+#endif
 
 // Utility Functions
 
-inline double DegreesToRadians(const double degrees)
+inline real DegreesToRadians(const real degrees)
 {
     return degrees * pi / 180;
 }
 
-inline double RandomDouble(const double min = 0, const double max = 1)
+// PCG32 (https://www.pcg-random.org): 64 bits of state, one multiply-add per
+// number, and any number of independent streams selected by the increment.
+class Pcg32
 {
-    // https://github.com/RayTracing/raytracing.github.io/discussions/1680
-    std::uniform_real_distribution<double> distribution(min, max);
+public:
+    Pcg32() {}
+
+    Pcg32(const uint64_t sequence, const uint64_t offset = 0)
+    {
+        Seed(sequence, offset);
+    }
+
+    void Seed(const uint64_t sequence, const uint64_t offset = 0)
+    {
+        this->state = 0;
+        this->increment = (sequence << 1) | 1;
+        NextUInt();
+        this->state += offset;
+        NextUInt();
+    }
+
+    uint32_t NextUInt()
+    {
+        const uint64_t old_state = this->state;
+        this->state = old_state * 6364136223846793005ULL + this->increment;
+
+        const uint32_t xor_shifted = uint32_t(((old_state >> 18) ^ old_state) >> 27);
+        const uint32_t rotation = uint32_t(old_state >> 59);
+
+        return (xor_shifted >> rotation) | (xor_shifted << ((~rotation + 1) & 31));
+    }
+
+    // Uniform in [0, 1), with 24 and 32 bits of resolution respectively.
+    float NextFloat()
+    {
+        return float(NextUInt() >> 8) * 0x1p-24f;
+    }
 
-    static std::mt19937 generator;
+    double NextDouble()
+    {
+        return double(NextUInt()) * 0x1p-32;
+    }
 
-    return distribution(generator);
+private:
+    uint64_t state     = 0x853c49e6748fea9bULL;
+    uint64_t increment = 0xda3e39cb94b95bdbULL;
+};
+
+inline Pcg32& RandomGenerator()
+{
+    // Every thread gets its own generator, so render workers never share state.
+    thread_local Pcg32 generator;
+
+    return generator;
+}
+
+inline void SeedRandom(const uint64_t sequence, const uint64_t offset = 0)
+{
+    // Re-seeding per unit of work (e.g. per pixel) makes the random sequence depend
+    // only on that unit and not on which thread picked it up.
+    RandomGenerator().Seed(sequence, offset);
+}
+
+inline double RandomDouble()
+{
+    return RandomGenerator().NextDouble();
+}
+
+inline double RandomDouble(const double min, const double max)
+{
+    return min + (max - min) * RandomDouble();
+}
+
+inline float RandomFloat()
+{
+    return RandomGenerator().NextFloat();
 }
 
 inline int RandomInt(const int min, const int max)
 {
     return int(RandomDouble(min, max + 1));
 }
+
+// Uniform in [0, 1) at the precision of `real`.
+inline real RandomReal()
+{
+#ifdef RT_USE_FLOAT
+    return RandomFloat();
+#else
+    return RandomDouble();
+#endif
+}
+
+inline real RandomReal(const real min, const real max)
+{
+    return min + (max - min) * RandomReal();
+}
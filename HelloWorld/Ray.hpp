@@ -7,7 +7,7 @@ class Ray
 public:
     Ray() {}
     Ray(const Point3& origin, const Vec3& direction) : origin(origin), direction(direction), time(0) {}
-    Ray(const Point3& origin, const Vec3& direction, const double time) : origin(origin), direction(direction), time(time) {}
+    Ray(const Point3& origin, const Vec3& direction, const real time) : origin(origin), direction(direction), time(time) {}
 
     const Point3& Origin() const
     {
@@ -19,12 +19,12 @@ public:
         return this->direction;
     }
 
-    Point3 At(const double t) const
+    Point3 At(const real t) const
     {
         return this->origin + t * this->direction;
     }
 
-    double Time() const
+    real Time() const
     {
         return time;
     }
@@ -32,5 +32,5 @@ public:
 private:
     Point3 origin;
     Vec3 direction;
-    double time = 0;
+    real time = 0;
 };
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "RTWeekend.hpp"
+
+#include "AABB.hpp"
+#include "Interval.hpp"
+#include "Ray.hpp"
+#include "Vec3.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+
+// Up to `size` coherent rays, such as the camera rays of neighbouring pixels,
+// traced through a hierarchy together: every box is tested against all of them
+// at once, and the lanes that miss it drop out of that subtree. Lanes are picked
+// with bit masks, bit `i` standing for lane `i`.
+class RayPacket
+{
+public:
+    static constexpr int size = 4;
+
+    Ray rays[size];
+
+    // Interval of every lane. `t_max` shrinks to the closest hit found so far.
+    alignas(32) real t_min[size] = {};
+    alignas(32) real t_max[size] = {};
+
+    // Random streams of the lanes, if each ray brings its own (camera rays of
+    // different pixels do). Primitives that draw random numbers while
+    // intersecting, like media, then draw from the stream of the lane.
+    Pcg32* generators = nullptr;
+
+    void SetLane(const int lane, const Ray& ray, const Interval ray_t)
+    {
+        this->rays[lane] = ray;
+        this->t_min[lane] = ray_t.min;
+        this->t_max[lane] = ray_t.max;
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            this->origin[axis][lane] = ray.Origin()[axis];
+            this->inv_direction[axis][lane] = 1 / ray.Direction()[axis];
+        }
+    }
+
+    Interval LaneInterval(const int lane) const
+    {
+        return Interval(this->t_min[lane], this->t_max[lane]);
+    }
+
+    bool DirectionNegative(const int lane, const int axis) const
+    {
+        return this->inv_direction[axis][lane] < 0;
+    }
+
+    // The lanes of `active` whose ray enters `bbox` within its interval. Same
+    // slab test as `AABB::Hit()`, one lane per vector element.
+    uint32_t Hit(const AABB& bbox, const uint32_t active) const
+    {
+#if RT_SIMD_VEC3
+        __m256d t_enter = _mm256_load_pd(this->t_min);
+        __m256d t_exit  = _mm256_load_pd(this->t_max);
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            const Interval& slab = bbox.AxisInterval(axis);
+            const __m256d origin = _mm256_load_pd(this->origin[axis]);
+            const __m256d inv_direction = _mm256_load_pd(this->inv_direction[axis]);
+
+            const __m256d t0 = _mm256_mul_pd(_mm256_sub_pd(_mm256_set1_pd(slab.min), origin), inv_direction);
+            const __m256d t1 = _mm256_mul_pd(_mm256_sub_pd(_mm256_set1_pd(slab.max), origin), inv_direction);
+
+            t_enter = _mm256_max_pd(t_enter, _mm256_min_pd(t0, t1));
+            t_exit  = _mm256_min_pd(t_exit, _mm256_max_pd(t0, t1));
+        }
+
+        return active & uint32_t(_mm256_movemask_pd(_mm256_cmp_pd(t_enter, t_exit, _CMP_LT_OQ)));
+#else
+        // Written lane by lane over the component arrays, which compilers turn
+        // into vector code on their own.
+        real t_enter[size], t_exit[size];
+        for (int lane = 0; lane < size; ++lane)
+        {
+            t_enter[lane] = this->t_min[lane];
+            t_exit[lane] = this->t_max[lane];
+        }
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            const Interval& slab = bbox.AxisInterval(axis);
+            for (int lane = 0; lane < size; ++lane)
+            {
+                const real t0 = (slab.min - this->origin[axis][lane]) * this->inv_direction[axis][lane];
+                const real t1 = (slab.max - this->origin[axis][lane]) * this->inv_direction[axis][lane];
+
+                t_enter[lane] = std::max(t_enter[lane], std::min(t0, t1));
+                t_exit[lane]  = std::min(t_exit[lane], std::max(t0, t1));
+            }
+        }
+
+        uint32_t mask = 0;
+        for (int lane = 0; lane < size; ++lane)
+        {
+            mask |= uint32_t(t_enter[lane] < t_exit[lane]) << lane;
+        }
+
+        return active & mask;
+#endif
+    }
+
+    // Calls `function(lane)` for every lane of `lanes`, lowest first.
+    template <typename Function>
+    static void ForEachLane(uint32_t lanes, Function&& function)
+    {
+        while (lanes != 0)
+        {
+            function(std::countr_zero(lanes));
+            lanes &= lanes - 1;
+        }
+    }
+
+private:
+    // The rays by component, so a box can be tested against all lanes at once.
+    alignas(32) real origin[3][size] = {};
+    alignas(32) real inv_direction[3][size] = {};
+};
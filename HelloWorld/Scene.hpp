@@ -0,0 +1,53 @@
+#pragma once
+
+#include "RTWeekend.hpp"
+
+#include "Hittable.hpp"
+#include "Util.hpp"
+
+#include <string>
+
+// A loaded OBJ file with everything derived from it that does not depend on the
+// camera: the mesh and its BVH, and the lights collected from it for light
+// sampling. It is built once when a file is loaded and renders that only change
+// camera or sampling settings reuse it as it is.
+class Scene
+{
+public:
+    // Replaces the scene with `filename`. No render may be reading the previous
+    // one.
+    void Load(const std::string& filename, const bool use_cache = true)
+    {
+        this->world = MeshLoad(filename, use_cache);
+
+        this->lights = Hit_List();
+        this->world.CollectLights(this->lights);
+
+        this->path = filename;
+    }
+
+    bool IsLoaded() const
+    {
+        return this->path.empty() == false;
+    }
+
+    const std::string& Path() const
+    {
+        return this->path;
+    }
+
+    const Hit_List& World() const
+    {
+        return this->world;
+    }
+
+    const Hit_List& Lights() const
+    {
+        return this->lights;
+    }
+
+private:
+    std::string path;
+    Hit_List world;
+    Hit_List lights;
+};
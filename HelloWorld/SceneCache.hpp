@@ -0,0 +1,457 @@
+#pragma once
+
+#include "RTWeekend.hpp"
+
+#include "BVH.hpp"
+#include "Hit_TriangleMesh.hpp"
+#include "MappedFile.hpp"
+#include "ObjParser.hpp"
+#include "Vec2.hpp"
+#include "Vec3.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+// Binary copy of what loading an OBJ file produces: the mesh buffers, the
+// material table with its texture references and the triangle BVH. It is kept
+// next to the OBJ as `<file>.rtcache` and is only used while the OBJ and its MTL
+// libraries still have the path, size and modification time recorded in it.
+//
+// Arrays are stored as raw bytes, so a cache only fits builds with the same
+// layout of `real`, `Vec3` and `BVHNode` (it records their sizes) and reads back
+// with a single copy per array out of a mapped view of the file.
+class SceneCache
+{
+public:
+    static std::string PathFor(const std::string& obj_path)
+    {
+        return obj_path + ".rtcache";
+    }
+
+    // Fills the buffers from the cache of `obj_path`. False if there is none or
+    // it no longer matches its sources.
+    static bool Load(const std::string& obj_path, MeshData& mesh, std::vector<tinyobj::material_t>& materials, BVH& bvh)
+    {
+        const MappedFile file(PathFor(obj_path));
+        if (file.IsOpen() == false)
+        {
+            return false;
+        }
+
+        Reader reader(file.Data(), file.Size());
+
+        Header header;
+        if (reader.Read(header) == false || std::memcmp(&header, &current_header, sizeof(Header)) != 0)
+        {
+            return false;
+        }
+
+        uint32_t source_count = 0;
+        if (reader.Read(source_count) == false || source_count == 0)
+        {
+            return false;
+        }
+
+        for (uint32_t i = 0; i < source_count; ++i)
+        {
+            Source recorded;
+            if (reader.ReadString(recorded.path) == false || reader.Read(recorded.size) == false || reader.Read(recorded.modified) == false)
+            {
+                return false;
+            }
+
+            // Sources are kept under their absolute paths. The first one is the
+            // OBJ file itself, so a cache copied next to another file is not used.
+            if (i == 0 && recorded.path != AbsolutePath(obj_path))
+            {
+                return false;
+            }
+
+            const Source current = Stamp(recorded.path);
+            if (current.size != recorded.size || current.modified != recorded.modified)
+            {
+                return false;
+            }
+        }
+
+        std::vector<BVHNode> nodes;
+        std::vector<uint32_t> bvh_indices;
+
+        uint64_t material_count = 0;
+        if (reader.ReadArray(mesh.positions) == false ||
+            reader.ReadArray(mesh.uvs) == false ||
+            reader.ReadArray(mesh.normals) == false ||
+            reader.ReadArray(mesh.indices) == false ||
+            reader.ReadArray(mesh.material_ids) == false ||
+            reader.Read(material_count) == false)
+        {
+            return false;
+        }
+
+        materials.clear();
+        for (uint64_t i = 0; i < material_count; ++i)
+        {
+            tinyobj::material_t material = {};
+            if (ReadMaterial(reader, material) == false)
+            {
+                return false;
+            }
+            materials.push_back(std::move(material));
+        }
+
+        if (reader.ReadArray(nodes) == false || reader.ReadArray(bvh_indices) == false || reader.AtEnd() == false)
+        {
+            return false;
+        }
+
+        if (IsConsistent(mesh, materials.size(), nodes, bvh_indices) == false)
+        {
+            return false;
+        }
+
+        bvh.Assign(std::move(nodes), std::move(bvh_indices));
+        return true;
+    }
+
+    // Writes the cache of `obj_path`. It is written to a temporary file first
+    // and then renamed, so an interrupted write never leaves a broken cache.
+    static bool Save(const std::string& obj_path, const std::vector<std::string>& material_libraries, const MeshData& mesh, const std::vector<tinyobj::material_t>& materials, const BVH& bvh, std::string& error)
+    {
+        const std::string path = PathFor(obj_path);
+        const std::string temporary_path = path + ".tmp";
+
+        {
+            std::ofstream stream(temporary_path, std::ios::binary | std::ios::trunc);
+            if (stream.is_open() == false)
+            {
+                error = "Cannot write [" + temporary_path + "]\n";
+                return false;
+            }
+
+            Writer writer(stream);
+
+            writer.Write(current_header);
+
+            writer.Write(uint32_t(1 + material_libraries.size()));
+            for (size_t i = 0; i <= material_libraries.size(); ++i)
+            {
+                const Source source = Stamp(AbsolutePath(i == 0 ? obj_path : material_libraries[i - 1]));
+                writer.WriteString(source.path);
+                writer.Write(source.size);
+                writer.Write(source.modified);
+            }
+
+            writer.WriteArray(mesh.positions);
+            writer.WriteArray(mesh.uvs);
+            writer.WriteArray(mesh.normals);
+            writer.WriteArray(mesh.indices);
+            writer.WriteArray(mesh.material_ids);
+
+            writer.Write(uint64_t(materials.size()));
+            for (const tinyobj::material_t& material : materials)
+            {
+                WriteMaterial(writer, material);
+            }
+
+            writer.WriteArray(bvh.nodes);
+            writer.WriteArray(bvh.indices);
+
+            if (stream.flush().good() == false)
+            {
+                error = "Cannot write [" + temporary_path + "]\n";
+                return false;
+            }
+        }
+
+        std::error_code error_code;
+        std::filesystem::rename(temporary_path, path, error_code);
+        if (error_code)
+        {
+            std::filesystem::remove(temporary_path, error_code);
+            error = "Cannot replace [" + path + "]\n";
+            return false;
+        }
+
+        return true;
+    }
+
+private:
+    // Raised whenever the layout below changes.
+    static constexpr uint32_t version = 2;
+
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t real_size;
+        uint32_t vec3_size;
+        uint32_t bvh_node_size;
+    };
+
+    static constexpr Header current_header = { { 'R', 'T', 'C', 'A', 'C', 'H', 'E', '\0' }, version, sizeof(real), sizeof(Vec3), sizeof(BVHNode) };
+
+    // A file the cache was made from. Missing files are recorded too, so a
+    // missing MTL library that shows up later invalidates the cache.
+    struct Source
+    {
+        std::string path;
+        uint64_t size = UINT64_MAX;
+        int64_t modified = 0;
+    };
+
+    static std::string AbsolutePath(const std::string& path)
+    {
+        std::error_code error_code;
+        const std::filesystem::path canonical = std::filesystem::weakly_canonical(path, error_code);
+        return error_code ? path : canonical.string();
+    }
+
+    static Source Stamp(const std::string& path)
+    {
+        Source source;
+        source.path = path;
+
+        std::error_code error_code;
+        const uintmax_t size = std::filesystem::file_size(path, error_code);
+        if (error_code)
+        {
+            return source;
+        }
+
+        const std::filesystem::file_time_type modified = std::filesystem::last_write_time(path, error_code);
+        if (error_code)
+        {
+            return source;
+        }
+
+        source.size = uint64_t(size);
+        source.modified = int64_t(modified.time_since_epoch().count());
+        return source;
+    }
+
+    class Writer
+    {
+    public:
+        explicit Writer(std::ofstream& stream) : stream(stream) {}
+
+        template <typename T>
+        void Write(const T& value)
+        {
+            static_assert(std::is_trivially_copyable_v<T>);
+            this->stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+
+        template <typename T>
+        void WriteArray(const std::vector<T>& values)
+        {
+            static_assert(std::is_trivially_copyable_v<T>);
+            Write(uint64_t(values.size()));
+            this->stream.write(reinterpret_cast<const char*>(values.data()), std::streamsize(values.size() * sizeof(T)));
+        }
+
+        void WriteString(const std::string& value)
+        {
+            Write(uint64_t(value.size()));
+            this->stream.write(value.data(), std::streamsize(value.size()));
+        }
+
+    private:
+        std::ofstream& stream;
+    };
+
+    // Reads out of the mapped cache, failing instead of running past its end.
+    class Reader
+    {
+    public:
+        Reader(const char* data, const size_t size) : p(data), end(data + size) {}
+
+        template <typename T>
+        bool Read(T& value)
+        {
+            static_assert(std::is_trivially_copyable_v<T>);
+            return Bytes(&value, sizeof(T));
+        }
+
+        template <typename T>
+        bool ReadArray(std::vector<T>& values)
+        {
+            static_assert(std::is_trivially_copyable_v<T>);
+
+            uint64_t count = 0;
+            if (Read(count) == false || count > Remaining() / sizeof(T))
+            {
+                return false;
+            }
+
+            values.resize(size_t(count));
+            return Bytes(values.data(), size_t(count) * sizeof(T));
+        }
+
+        bool ReadString(std::string& value)
+        {
+            uint64_t length = 0;
+            if (Read(length) == false || length > Remaining())
+            {
+                return false;
+            }
+
+            value.assign(this->p, size_t(length));
+            this->p += length;
+            return true;
+        }
+
+        bool AtEnd() const
+        {
+            return this->p == this->end;
+        }
+
+    private:
+        const char* p;
+        const char* end;
+
+        size_t Remaining() const
+        {
+            return size_t(this->end - this->p);
+        }
+
+        bool Bytes(void* out, const size_t count)
+        {
+            if (count > Remaining())
+            {
+                return false;
+            }
+
+            if (count > 0)
+            {
+                std::memcpy(out, this->p, count);
+            }
+            this->p += count;
+            return true;
+        }
+    };
+
+    // Only what `MaterialFromObj()` looks at is kept.
+    static void WriteMaterial(Writer& writer, const tinyobj::material_t& material)
+    {
+        writer.WriteString(material.name);
+        writer.WriteString(material.diffuse_texname);
+
+        for (int i = 0; i < 3; ++i)
+        {
+            writer.Write(double(material.diffuse[i]));
+            writer.Write(double(material.emission[i]));
+            writer.Write(double(material.transmittance[i]));
+        }
+
+        writer.Write(double(material.ior));
+        writer.Write(double(material.metallic));
+        writer.Write(double(material.roughness));
+    }
+
+    static bool ReadMaterial(Reader& reader, tinyobj::material_t& material)
+    {
+        if (reader.ReadString(material.name) == false || reader.ReadString(material.diffuse_texname) == false)
+        {
+            return false;
+        }
+
+        double values[12];
+        for (double& value : values)
+        {
+            if (reader.Read(value) == false)
+            {
+                return false;
+            }
+        }
+
+        for (int i = 0; i < 3; ++i)
+        {
+            material.diffuse[i] = values[3 * i + 0];
+            material.emission[i] = values[3 * i + 1];
+            material.transmittance[i] = values[3 * i + 2];
+        }
+
+        material.ior = values[9];
+        material.metallic = values[10];
+        material.roughness = values[11];
+        return true;
+    }
+
+    // Guards against a damaged cache: every index has to stay in its array, and
+    // the BVH has to be a tree the traversal can walk.
+    static bool IsConsistent(const MeshData& mesh, const size_t material_count, const std::vector<BVHNode>& nodes, const std::vector<uint32_t>& bvh_indices)
+    {
+        const size_t face_count = mesh.FaceCount();
+
+        if (mesh.indices.size() != 3 * face_count ||
+            mesh.material_ids.size() != face_count ||
+            bvh_indices.size() != face_count ||
+            (mesh.uvs.empty() == false && mesh.uvs.size() != mesh.positions.size()) ||
+            (mesh.normals.empty() == false && mesh.normals.size() != mesh.positions.size()) ||
+            (face_count > 0 && nodes.empty()))
+        {
+            return false;
+        }
+
+        for (const uint32_t index : mesh.indices)
+        {
+            if (index >= mesh.positions.size())
+            {
+                return false;
+            }
+        }
+
+        for (const uint32_t material_id : mesh.material_ids)
+        {
+            if (material_id > material_count)
+            {
+                return false;
+            }
+        }
+
+        for (const uint32_t face : bvh_indices)
+        {
+            if (face >= face_count)
+            {
+                return false;
+            }
+        }
+
+        // Traversal and `BVH::ComputeStats()` walk the tree with fixed-size
+        // stacks, so it has to be in the depth-first layout the builder writes
+        // (both children after their parent, which rules out cycles) and no
+        // deeper than `BVH::max_depth`. Children come after their parents, so
+        // one pass in order finds every node's depth.
+        std::vector<int> depths(nodes.size(), 1);
+        for (size_t index = 0; index < nodes.size(); ++index)
+        {
+            const BVHNode& node = nodes[index];
+
+            if (node.IsLeaf())
+            {
+                if (size_t(node.offset) + node.primitive_count > face_count)
+                {
+                    return false;
+                }
+                continue;
+            }
+
+            if (node.offset <= index + 1 || node.offset >= nodes.size() || depths[index] >= BVH::max_depth)
+            {
+                return false;
+            }
+
+            depths[index + 1] = std::max(depths[index + 1], depths[index] + 1);
+            depths[node.offset] = std::max(depths[node.offset], depths[index] + 1);
+        }
+
+        return true;
+    }
+};
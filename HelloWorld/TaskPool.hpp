@@ -0,0 +1,175 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// A fixed set of worker threads that run short tasks from a shared queue. Tasks
+// belong to a `TaskPool::Group`, and `Wait()` on a group runs queued tasks on the
+// calling thread until the group is done. Tasks can therefore fork tasks of their
+// own and wait for them without tying up a thread each, and no more threads than
+// the pool was made with ever run at once.
+class TaskPool
+{
+public:
+    class Group
+    {
+    private:
+        friend class TaskPool;
+        std::atomic<size_t> pending = 0;
+    };
+
+    // The thread that calls `Wait()` works too, so `thread_count - 1` workers are
+    // started.
+    explicit TaskPool(const int thread_count)
+    {
+        for (int i = 1; i < thread_count; ++i)
+        {
+            this->threads.emplace_back([this]() { this->WorkerLoop(); });
+        }
+    }
+
+    ~TaskPool()
+    {
+        {
+            const std::lock_guard<std::mutex> lock(this->mutex);
+            this->stopping = true;
+        }
+        this->wake.notify_all();
+
+        for (std::thread& thread : this->threads)
+        {
+            thread.join();
+        }
+    }
+
+    TaskPool(const TaskPool&) = delete;
+    TaskPool& operator=(const TaskPool&) = delete;
+
+    int ThreadCount() const
+    {
+        return (int)this->threads.size() + 1;
+    }
+
+    void Run(Group& group, std::function<void()> function)
+    {
+        group.pending.fetch_add(1, std::memory_order_relaxed);
+        {
+            const std::lock_guard<std::mutex> lock(this->mutex);
+            this->tasks.push_back(Task{ &group, std::move(function) });
+        }
+        this->wake.notify_one();
+    }
+
+    // Returns once every task of `group` has finished, running queued tasks
+    // meanwhile.
+    void Wait(Group& group)
+    {
+        while (group.pending.load(std::memory_order_acquire) > 0)
+        {
+            // The newest task is most likely one of the group's own.
+            Task task;
+            if (this->Take(task, false))
+            {
+                Execute(task);
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    // Runs `function(chunk, chunk_begin, chunk_end)` for `chunk_count` equal
+    // chunks of `[begin, end)`, and returns when all of them are done.
+    template <typename Function>
+    void ForEachChunk(const size_t begin, const size_t end, const size_t chunk_count, Function&& function)
+    {
+        const size_t chunk_size = (end - begin + chunk_count - 1) / chunk_count;
+
+        Group group;
+        for (size_t chunk = 1; chunk < chunk_count; ++chunk)
+        {
+            const size_t chunk_begin = std::min(begin + chunk * chunk_size, end);
+            const size_t chunk_end = std::min(chunk_begin + chunk_size, end);
+            this->Run(group, [&function, chunk, chunk_begin, chunk_end]()
+            {
+                function(chunk, chunk_begin, chunk_end);
+            });
+        }
+
+        function(size_t(0), begin, std::min(begin + chunk_size, end));
+        this->Wait(group);
+    }
+
+private:
+    struct Task
+    {
+        Group* group = nullptr;
+        std::function<void()> function;
+    };
+
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Task> tasks;
+    bool stopping = false;
+
+    bool Take(Task& task, const bool oldest)
+    {
+        const std::lock_guard<std::mutex> lock(this->mutex);
+        if (this->tasks.empty())
+        {
+            return false;
+        }
+
+        if (oldest)
+        {
+            task = std::move(this->tasks.front());
+            this->tasks.pop_front();
+        }
+        else
+        {
+            task = std::move(this->tasks.back());
+            this->tasks.pop_back();
+        }
+        return true;
+    }
+
+    static void Execute(Task& task)
+    {
+        task.function();
+        task.group->pending.fetch_sub(1, std::memory_order_release);
+    }
+
+    // Workers take the oldest tasks, which are the largest ones in a recursive
+    // build.
+    void WorkerLoop()
+    {
+        while (true)
+        {
+            Task task;
+            {
+                std::unique_lock<std::mutex> lock(this->mutex);
+                this->wake.wait(lock, [this]() { return this->stopping || this->tasks.empty() == false; });
+
+                if (this->tasks.empty())
+                {
+                    return;
+                }
+
+                task = std::move(this->tasks.front());
+                this->tasks.pop_front();
+            }
+
+            Execute(task);
+        }
+    }
+};
@@ -4,6 +4,7 @@
 #include "Image.hpp"
 #include "Interval.hpp"
 #include "Perlin.hpp"
+#include "TextureCache.hpp"
 #include "Vec3.hpp"
 
 #include <cmath>
@@ -19,7 +20,7 @@ class Texture
 public:
     virtual ~Texture() = default;
 
-    virtual Color Value(const double u, const double v, const Point3& p) const = 0;
+    virtual Color Value(const real u, const real v, const Point3& p) const = 0;
 };
 
 class Tex_SolidColor : public Texture
@@ -27,9 +28,9 @@ class Tex_SolidColor : public Texture
 public:
     Tex_SolidColor(const Color& albedo) : albedo(albedo) {}
 
-    Tex_SolidColor(const double r, const double g, const double b) : Tex_SolidColor(Color(r, g, b)) {}
+    Tex_SolidColor(const real r, const real g, const real b) : Tex_SolidColor(Color(r, g, b)) {}
 
-    Color Value(const double u, const double v, const Point3& p) const
+    Color Value(const real u, const real v, const Point3& p) const
     {
         return this->albedo;
     }
@@ -41,13 +42,13 @@ private:
 class Tex_Checker : public Texture
 {
 public:
-    Tex_Checker(const double scale, const shared_ptr<Texture> even, const shared_ptr<Texture> odd) :
+    Tex_Checker(const real scale, const shared_ptr<Texture> even, const shared_ptr<Texture> odd) :
         inv_scale(1.0 / scale), even(even), odd(odd) {}
 
-    Tex_Checker(const double scale, const Color& color_0, const Color& color_1) :
+    Tex_Checker(const real scale, const Color& color_0, const Color& color_1) :
         Tex_Checker(scale, make_shared<Tex_SolidColor>(color_0), make_shared<Tex_SolidColor>(color_1)) {}
 
-    Color Value(const double u, const double v, const Point3& p) const override
+    Color Value(const real u, const real v, const Point3& p) const override
     {
         const int floor_x = int(std::floor(p.x() * this->inv_scale));
         const int floor_y = int(std::floor(p.y() * this->inv_scale));
@@ -64,7 +65,7 @@ public:
     }
 
 private:
-    double inv_scale;
+    real inv_scale;
 
     shared_ptr<Texture> even;
     shared_ptr<Texture> odd;
@@ -73,40 +74,41 @@ private:
 class Tex_Perlin : public Texture
 {
 public:
-    Tex_Perlin(const double scale) : scale(scale) {}
+    Tex_Perlin(const real scale) : scale(scale) {}
 
-    Color Value(const double u, const double v, const Point3& p) const override
+    Color Value(const real u, const real v, const Point3& p) const override
     {
         return Color(1, 1, 1) * perlin.Turbulence(p, 7);
     }
 
 private:
     Perlin perlin;
-    double scale;
+    real scale;
 };
 
 class Tex_Image : public Texture
 {
 public:
-    Tex_Image(const std::string& filename) : image(filename) {}
+    // Materials naming the same file share its pixels (see `TextureCache`).
+    Tex_Image(const std::string& filename) : image(TextureCache::Get(filename)) {}
 
-    Color Value(double u, double v, const Point3& p) const override
+    Color Value(real u, real v, const Point3& p) const override
     {
         // Return cyan if texture is missing.
-        if (this->image.height <= 0) return Color(0, 1, 1);
+        if (this->image->height <= 0) return Color(0, 1, 1);
 
         u = Interval(0, 1).Clamp(u);
         v = 1.0 - Interval(0, 1).Clamp(v);
 
-        const int i = int(u * image.width);
-        const int j = int(v * image.height);
-        const uint8_t* pixel = image.PixelData(i, j);
+        const int i = int(u * image->width);
+        const int j = int(v * image->height);
+        const uint8_t* pixel = image->PixelData(i, j);
 
-        constexpr double color_scale = 1.0 / 255.0;
+        constexpr real color_scale = 1.0 / 255.0;
 
         return Color(color_scale * pixel[0], color_scale * pixel[1], color_scale * pixel[2]);
     }
 
 private:
-    Image image;
+    shared_ptr<const Image> image;
 };
@@ -0,0 +1,156 @@
+#pragma once
+
+#include "Image.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using std::make_shared;
+using std::shared_ptr;
+
+// Process-wide cache of decoded texture images, keyed by canonical path. A file
+// is decoded once for as long as anything uses it, and every material naming it
+// shares the same pixels. Entries do not keep images alive on their own, so the
+// textures of a scene go away with it unless the next scene uses them too.
+class TextureCache
+{
+public:
+    // Returns nullptr, and says why in `error`, if the file can't be decoded.
+    // Failures are not cached, the next call tries again.
+    static shared_ptr<const Image> Get(const std::string& filename, std::string& error)
+    {
+        const std::string key = Key(filename);
+
+        {
+            const std::lock_guard<std::mutex> lock(Mutex());
+            const auto it = Entries().find(key);
+            if (it != Entries().end())
+            {
+                if (shared_ptr<const Image> image = it->second.lock())
+                {
+                    return image;
+                }
+
+                // Released since, by the scene that used it last.
+                Entries().erase(it);
+            }
+        }
+
+        // Decoded without the lock, so other files can be decoded meanwhile. If
+        // another thread decodes the same file at the same time, the image stored
+        // first wins.
+        std::string decode_error;
+        shared_ptr<const Image> image = make_shared<const Image>(filename, decode_error);
+        if (decode_error.empty() == false)
+        {
+            error = decode_error;
+            return nullptr;
+        }
+
+        const std::lock_guard<std::mutex> lock(Mutex());
+        std::weak_ptr<const Image>& entry = Entries()[key];
+        if (shared_ptr<const Image> cached = entry.lock())
+        {
+            return cached;
+        }
+
+        entry = image;
+        return image;
+    }
+
+    // Same, but a file that can't be decoded is fatal, like it always was for
+    // textures created one at a time.
+    static shared_ptr<const Image> Get(const std::string& filename)
+    {
+        std::string error;
+        shared_ptr<const Image> image = Get(filename, error);
+        if (image == nullptr)
+        {
+            std::cerr << "[ERROR]:\t" << error << "\n";
+            exit(1);
+        }
+
+        return image;
+    }
+
+    // Decodes `filenames` on one thread per hardware thread. Holding on to the
+    // result keeps them cached, so the `Get()` calls that follow all hit. Files
+    // that can't be decoded are left null and their errors go to `errors`, for
+    // the calling thread to report.
+    static std::vector<shared_ptr<const Image>> Preload(const std::vector<std::string>& filenames, std::vector<std::string>& errors)
+    {
+        // Entries of images no scene holds any more, which `Get()` only drops
+        // when their file is asked for again.
+        {
+            const std::lock_guard<std::mutex> lock(Mutex());
+            std::erase_if(Entries(), [](const auto& entry) { return entry.second.expired(); });
+        }
+
+        std::vector<shared_ptr<const Image>> images(filenames.size());
+        std::vector<std::string> file_errors(filenames.size());
+        std::atomic<size_t> next = 0;
+
+        const auto decode = [&]()
+        {
+            for (size_t i = next++; i < filenames.size(); i = next++)
+            {
+                images[i] = Get(filenames[i], file_errors[i]);
+            }
+        };
+
+        const size_t thread_count = std::min<size_t>(filenames.size(), std::max(1u, std::thread::hardware_concurrency()));
+
+        std::vector<std::thread> threads;
+        for (size_t i = 1; i < thread_count; ++i)
+        {
+            threads.emplace_back(decode);
+        }
+
+        decode();
+
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+
+        for (const std::string& file_error : file_errors)
+        {
+            if (file_error.empty() == false)
+            {
+                errors.push_back(file_error);
+            }
+        }
+
+        return images;
+    }
+
+private:
+    static std::string Key(const std::string& filename)
+    {
+        std::error_code error_code;
+        const std::filesystem::path canonical = std::filesystem::weakly_canonical(filename, error_code);
+        return error_code ? filename : canonical.string();
+    }
+
+    static std::mutex& Mutex()
+    {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    static std::unordered_map<std::string, std::weak_ptr<const Image>>& Entries()
+    {
+        static std::unordered_map<std::string, std::weak_ptr<const Image>> entries;
+        return entries;
+    }
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+// Ray/triangle intersection kernel. Returns the distance and the barycentric
+// coordinates (b1, b2) of the second and third vertex, so callers can use the
+// same numbers for the inside test and for interpolating vertex attributes.
+
+#include "RTWeekend.hpp"
+
+#include "Interval.hpp"
+#include "Ray.hpp"
+#include "Vec3.hpp"
+
+#include <cmath>
+
+// Moller-Trumbore. Takes the triangle as one vertex and the two edges leaving
+// it, which is exactly how `Hit_Quad`/`Hit_Tri` store their geometry.
+inline bool IntersectTriangle(
+    const Ray& ray, const Interval& ray_t,
+    const Point3& p0, const Vec3& edge_1, const Vec3& edge_2,
+    real& t, real& b1, real& b2)
+{
+    const Vec3 p = Cross(ray.Direction(), edge_2);
+    const real determinant = Dot(edge_1, p);
+    // Only a ray exactly parallel to the triangle is rejected here. Any fixed
+    // threshold depends on the scale of the mesh (and of `real`) and would drop
+    // small or thin triangles. Nearly parallel rays get barycentrics far out of
+    // range or a t outside `ray_t` (NaN included) and fail the tests below.
+    if (determinant == 0)
+    {
+        return false;
+    }
+
+    const real inv_determinant = 1 / determinant;
+
+    const Vec3 s = ray.Origin() - p0;
+    b1 = Dot(s, p) * inv_determinant;
+    if (b1 < 0 || b1 > 1)
+    {
+        return false;
+    }
+
+    const Vec3 q = Cross(s, edge_1);
+    b2 = Dot(ray.Direction(), q) * inv_determinant;
+    if (b2 < 0 || b1 + b2 > 1)
+    {
+        return false;
+    }
+
+    t = Dot(edge_2, q) * inv_determinant;
+    return ray_t.Contains(t);
+}
@@ -1,177 +1,204 @@
 #pragma once
 
-#define TINYOBJLOADER_IMPLEMENTATION
-#define TINYOBJLOADER_USE_DOUBLE
-#include "include/tiny_obj_loader.h"
-
 #include "Color.hpp"
+#include "Hit_TriangleMesh.hpp"
 #include "Hittable.hpp"
 #include "Material.hpp"
+#include "ObjParser.hpp"
+#include "SceneCache.hpp"
 #include "Vec3.hpp"
 
 #include "Texture.hpp"
+#include "TextureCache.hpp"
 #include "Vec2.hpp"
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <cstdlib>
 #include <iostream>
 #include <memory>
 #include <string>
 #include <vector>
 
-Hit_List MeshLoad(const std::string& filename)
+// What `MaterialFromObj()` turns an OBJ material into.
+enum class ObjMaterialKind
 {
-    tinyobj::ObjReaderConfig reader_config;
-    /// Default = "" = search from the same directory of .obj file.
-    reader_config.mtl_search_path = ""; // Path to material files
+    Light,       // Emissive (`Ke`).
+    Dielectric,  // Fully transmissive (`Tf 1 1 1`).
+    Metal,       // `Pm 1`.
+    Lambertian,  // Everything else, textured if it has a `map_Kd`.
+};
 
-    tinyobj::ObjReader reader;
-    if (reader.ParseFromFile(filename, reader_config) == false)
+inline ObjMaterialKind ClassifyObjMaterial(const tinyobj::material_t& mat_raw)
+{
+    if (mat_raw.emission[0] > 0 || mat_raw.emission[1] > 0 || mat_raw.emission[2] > 0)
     {
-        if (reader.Error().empty() == false)
-        {
-            std::cerr << "[ERROR]: TinyObjReader: " << reader.Error();
-        }
-        exit(1);
+        return ObjMaterialKind::Light;
     }
-
-    if (!reader.Warning().empty())
+    else if (
+        mat_raw.transmittance[0] == 1.0 &&
+        mat_raw.transmittance[1] == 1.0 &&
+        mat_raw.transmittance[2] == 1.0
+        )
     {
-        std::cout << "TinyObjReader: " << reader.Warning();
+        return ObjMaterialKind::Dielectric;
     }
+    else if (mat_raw.metallic == 1)
+    {
+        return ObjMaterialKind::Metal;
+    }
+    return ObjMaterialKind::Lambertian;
+}
 
-    auto& attrib = reader.GetAttrib();
-    auto& shapes = reader.GetShapes();
-    auto& materials = reader.GetMaterials();
-
-    Hit_List world;
-    std::vector<shared_ptr<Material>> mats(materials.size(), nullptr);
+// Image file the material made of `mat_raw` samples, empty if none.
+inline std::string ObjMaterialTexture(const tinyobj::material_t& mat_raw)
+{
+    return ClassifyObjMaterial(mat_raw) == ObjMaterialKind::Lambertian ? mat_raw.diffuse_texname : std::string();
+}
 
-    // Loop over shapes.
-    for (size_t s = 0; s < shapes.size(); ++s)
+inline shared_ptr<Material> MaterialFromObj(const tinyobj::material_t& mat_raw)
+{
+    switch (ClassifyObjMaterial(mat_raw))
     {
-        // Loop over faces(polygon).
-        size_t index_offset = 0;
-        for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); ++f)
-        {
-            size_t fv = size_t(shapes[s].mesh.num_face_vertices[f]);
+    case ObjMaterialKind::Light:
+        return make_shared<Mat_DiffuseLight>(Color(
+            mat_raw.emission[0], mat_raw.emission[1], mat_raw.emission[2])
+        );
 
-            std::vector<Point3> tri_points;
-            tri_points.resize(3);
+    case ObjMaterialKind::Dielectric:
+        return make_shared<Mat_Dielectric>(mat_raw.ior);
 
-            // Loop over vertices in the face.
-            for (size_t v = 0; v < fv; ++v)
-            {
-                // access to vertex
-                tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
-                const double vx = attrib.vertices[3 * size_t(idx.vertex_index) + 0];
-                const double vy = attrib.vertices[3 * size_t(idx.vertex_index) + 1];
-                const double vz = attrib.vertices[3 * size_t(idx.vertex_index) + 2];
+    case ObjMaterialKind::Metal:
+        return make_shared<Mat_Metal>(Color(
+            mat_raw.diffuse[0], mat_raw.diffuse[1], mat_raw.diffuse[2]),
+            mat_raw.roughness);
 
-                tri_points[v] = Point3(vx, vy, vz);
-            }
+    default:
+        if (mat_raw.diffuse_texname != "")
+        {
+            return make_shared<Mat_Lambertian>(make_shared<Tex_Image>(
+                mat_raw.diffuse_texname
+            ));
+        }
+        else
+        {
+            return make_shared<Mat_Lambertian>(Color(
+                mat_raw.diffuse[0], mat_raw.diffuse[1], mat_raw.diffuse[2])
+            );
+        }
+    }
+}
 
-            // Construct material.
-            //
+// Loads `filename` as a single mesh. Unless `use_cache` is false, the parsed
+// mesh and its BVH are read from and written to the file's `SceneCache`.
+Hit_List MeshLoad(const std::string& filename, const bool use_cache = true)
+{
+    auto mesh = make_shared<MeshData>();
+    std::vector<tinyobj::material_t> materials;
+    BVH bvh;
 
-            shared_ptr<Material> mat = nullptr;
+    if (use_cache == false || SceneCache::Load(filename, *mesh, materials, bvh) == false)
+    {
+        *mesh = MeshData();
+        materials.clear();
 
-            // per-face material
-            const int mat_id = shapes[s].mesh.material_ids[f];
-            const tinyobj::material_t& mat_raw = materials[mat_id];
+        std::vector<std::string> material_libraries;
+        std::string warning, error;
+        if (ObjParser::Parse(filename, *mesh, materials, material_libraries, warning, error) == false)
+        {
+            std::cerr << "[ERROR]: ObjParser: " << error;
+            exit(1);
+        }
 
-            if (mats[mat_id] == nullptr)
+        if (warning.empty() == false)
+        {
+            std::cout << "ObjParser: " << warning;
+        }
+
+        // Vertices without a normal in the file get the normal of the first face
+        // that uses them, so the whole mesh can be shaded the same way.
+        if (mesh->normals.empty() == false)
+        {
+            for (size_t face = 0; face < mesh->FaceCount(); ++face)
             {
-                // Material has not been constructed yet.
-
-                if (
-                    mat_raw.transmittance[0] == 1.0 &&
-                    mat_raw.transmittance[1] == 1.0 &&
-                    mat_raw.transmittance[2] == 1.0
-                    )
-                { 
-                    // Dielectric.
-                    mat = make_shared<Mat_Dielectric>(mat_raw.ior);
-                }
-                else if (mat_raw.metallic == 1)
+                const uint32_t i0 = mesh->indices[3 * face + 0];
+                const uint32_t i1 = mesh->indices[3 * face + 1];
+                const uint32_t i2 = mesh->indices[3 * face + 2];
+
+                const Vec3 face_normal = Cross(mesh->positions[i1] - mesh->positions[i0], mesh->positions[i2] - mesh->positions[i0]);
+                if (face_normal.NearZero())
                 {
-                    // Metal.
-                    mat = make_shared<Mat_Metal>(Color(
-                        mat_raw.diffuse[0], mat_raw.diffuse[1], mat_raw.diffuse[2]),
-                        mat_raw.roughness);
+                    continue;
                 }
-                else
+
+                for (const uint32_t i : { i0, i1, i2 })
                 {
-                    // Lambertian.
-                    if (mat_raw.diffuse_texname != "")
-                    {
-                        mat = make_shared<Mat_Lambertian>(make_shared<Tex_Image>(
-                            mat_raw.diffuse_texname
-                        ));
-                    }
-                    else
+                    if (mesh->normals[i].NearZero())
                     {
-                        mat = make_shared<Mat_Lambertian>(Color(
-                            mat_raw.diffuse[0], mat_raw.diffuse[1], mat_raw.diffuse[2])
-                        );
+                        mesh->normals[i] = UnitVector(face_normal);
                     }
                 }
-
-                mats[mat_id] = mat;
             }
-            else
-            {
-                // Material was already constructed.
+        }
 
-                mat = mats[mat_id];
-            }
+        bvh = Hit_TriangleMesh::BuildBVH(*mesh);
 
-            // Construct triangle.
-            // 
-            // Triangles in the project are stored as Q, u, v, where:
-            // Q    - origin point;
-            // u, v - vectors originating in Q that represent triangle sides.
-            // 
-            // Given that, we construct triangle with Q, (R - Q), (S - Q),
-            // where R and S are triangle points obtained from .obj file.
+        if (use_cache && SceneCache::Save(filename, material_libraries, *mesh, materials, bvh, error) == false)
+        {
+            std::cout << "SceneCache: " << error;
+        }
+    }
 
-            if (mat_raw.diffuse_texname != "")
-            {
-                std::vector<Vec2> uv = std::vector<Vec2>(3);
+    // Materials are constructed in order of first use, so textures of unused
+    // materials are never loaded. Faces without a material get a plain grey one
+    // at the end of the table.
+    std::vector<int> material_slots(materials.size() + 1, -1);
+    std::vector<uint32_t> used_materials;
 
-                // Loop over vertices in the face.
-                for (size_t v = 0; v < fv; ++v)
-                {
-                    // access to vertex
-                    tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
-                    tinyobj::real_t tx = attrib.texcoords[2 * size_t(idx.texcoord_index) + 0];
-                    tinyobj::real_t ty = attrib.texcoords[2 * size_t(idx.texcoord_index) + 1];
+    for (uint32_t& material_id : mesh->material_ids)
+    {
+        if (material_slots[material_id] < 0)
+        {
+            material_slots[material_id] = (int)used_materials.size();
+            used_materials.push_back(material_id);
+        }
 
-                    uv[v] = Vec2(tx, ty);
-                }
+        material_id = (uint32_t)material_slots[material_id];
+    }
 
-                world.Add(make_shared<Hit_Tri>(
-                    tri_points[0],
-                    tri_points[1] - tri_points[0],
-                    tri_points[2] - tri_points[0],
-                    uv,
-                    mat
-                ));
-            }
-            else
-            {
-                world.Add(make_shared<Hit_Tri>(
-                    tri_points[0],
-                    tri_points[1] - tri_points[0],
-                    tri_points[2] - tri_points[0],
-                    mat
-                ));
-            }
+    // The textures are decoded up front, each file once and all files in
+    // parallel. The materials below find them in the cache, which `textures`
+    // keeps them in until then.
+    std::vector<std::string> texture_files;
+    for (const uint32_t material_id : used_materials)
+    {
+        const std::string texture = material_id == materials.size() ? std::string() : ObjMaterialTexture(materials[material_id]);
+        if (texture.empty() == false && std::find(texture_files.begin(), texture_files.end(), texture) == texture_files.end())
+        {
+            texture_files.push_back(texture);
+        }
+    }
 
-            index_offset += fv;
+    std::vector<std::string> texture_errors;
+    const std::vector<shared_ptr<const Image>> textures = TextureCache::Preload(texture_files, texture_errors);
+    if (texture_errors.empty() == false)
+    {
+        for (const std::string& error : texture_errors)
+        {
+            std::cerr << "[ERROR]: TextureCache: " << error << "\n";
         }
+        exit(1);
+    }
+
+    for (const uint32_t material_id : used_materials)
+    {
+        mesh->materials.push_back(material_id == materials.size()
+            ? make_shared<Mat_Lambertian>(Color(0.5, 0.5, 0.5))
+            : MaterialFromObj(materials[material_id])
+        );
     }
 
-    return world;
+    return Hit_List(make_shared<Hit_TriangleMesh>(mesh, std::move(bvh)));
 }
 
 inline static double LinearToGamma(const double linear_component)
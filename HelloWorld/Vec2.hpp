@@ -10,17 +10,17 @@
 class Vec2
 {
 public:
-    double e[2];
+    real e[2];
 
     Vec2() : e{ 0, 0 } {}
-    Vec2(const double e0, const double e1) : e{ e0, e1 } {}
+    Vec2(const real e0, const real e1) : e{ e0, e1 } {}
 
-    double x() const { return this->e[0]; }
-    double y() const { return this->e[1]; }
+    real x() const { return this->e[0]; }
+    real y() const { return this->e[1]; }
 
     Vec2 operator-() const { return Vec2(-e[0], -e[1]); }
-    double operator[](int i) const { return e[i]; }
-    double& operator[](int i) { return e[i]; }
+    real operator[](int i) const { return e[i]; }
+    real& operator[](int i) { return e[i]; }
 
     Vec2& operator+=(const Vec2& v)
     {
@@ -34,42 +34,42 @@ public:
         return *this += -v;
     }
 
-    Vec2& operator*=(const double t)
+    Vec2& operator*=(const real t)
     {
         e[0] *= t;
         e[1] *= t;
         return *this;
     }
 
-    Vec2& operator/=(double t)
+    Vec2& operator/=(real t)
     {
         return *this *= 1 / t;
     }
 
-    double LengthSquared() const
+    real LengthSquared() const
     {
         return e[0] * e[0] + e[1] * e[1];
     }
 
-    double Length() const
+    real Length() const
     {
         return std::sqrt(LengthSquared());
     }
 
     bool NearZero() const
     {
-        constexpr double s = 1e-8;
+        constexpr real s = 1e-8;
         return (std::abs(e[0]) < s) && (std::abs(e[1]) < s);
     }
 
     static Vec2 Random()
     {
-        return Vec2(RandomDouble(), RandomDouble());
+        return Vec2(RandomReal(), RandomReal());
     }
 
-    static Vec2 Random(const double min, const double max)
+    static Vec2 Random(const real min, const real max)
     {
-        return Vec2(RandomDouble(min, max), RandomDouble(min, max));
+        return Vec2(RandomReal(min, max), RandomReal(min, max));
     }
 };
 
@@ -97,17 +97,17 @@ inline Vec2 operator*(const Vec2& u, const Vec2& v)
     return Vec2(u.x() * v.x(), u.y() * v.y());
 }
 
-inline Vec2 operator*(const double t, const Vec2& v)
+inline Vec2 operator*(const real t, const Vec2& v)
 {
     return Vec2(t * v.x(), t * v.y());
 }
 
-inline Vec2 operator*(const Vec2& v, const double t)
+inline Vec2 operator*(const Vec2& v, const real t)
 {
     return t * v;
 }
 
-inline Vec2 operator/(const Vec2& v, const double t)
+inline Vec2 operator/(const Vec2& v, const real t)
 {
     return (1 / t) * v;
 }